@@ -15,7 +15,16 @@
 
 #define ANIM_SOURCE_WIDTH 256
 #define ANIM_SOURCE_HEIGHT 200
-#define MAX_TWEENED_VERTICES 512
+
+// Number of animation blocks kept loaded.
+#ifndef ANIM_WINDOW_BLOCKS
+#define ANIM_WINDOW_BLOCKS 4
+#endif
+
+// Number of distinct tweens whose intermediate shapes are kept between frames.
+#ifndef TWEEN_CACHE_ENTRIES
+#define TWEEN_CACHE_ENTRIES 8
+#endif
 
 static float anim_scale_x;
 static float anim_scale_y;
@@ -31,8 +40,16 @@ static bool anim_multidraw_3d;
 
 //#define MAX_SIMULTANEOUS_ANIM 2
 
-struct animation current_anim, prev_anim;
-uint8_t current_tween[MAX_TWEENED_VERTICES * 2];
+/* Recently-used blocks of (split) animations, so that tweens can reach back
+ * into earlier blocks and the next block can be loaded ahead of time. */
+static struct animation anim_window[ANIM_WINDOW_BLOCKS];
+static struct animation *playing_anim; // never evicted
+static unsigned anim_clock;
+static uint8_t *current_tween; // vertex count, then (y, x) pairs
+
+static void tween_cache_flush();
+static uint8_t *anim_resolve_before(struct animation *anim, ptrdiff_t offset, uint8_t **past_data_end);
+static bool tween_reserve(int points);
 
 void anim_set_zoom(int zoom_in) {
 	anim_zoom = zoom_in;
@@ -66,7 +83,19 @@ void anim_init()
 	anim_set_outline(false);
 	anim_set_multidraw_3d(false);
 
-	current_anim.data_file = prev_anim.data_file = -1;
+	for(int i = 0; i < ANIM_WINDOW_BLOCKS; i++) {
+		anim_window[i].data_file = anim_window[i].prev_data_file = -1;
+	}
+	playing_anim = NULL;
+
+	tween_cache_flush();
+}
+
+/* Size the polygon and tween buffers up front for the largest shape the
+ * demo draws, so they never grow (and leak reserved memory) mid-scene. */
+bool anim_reserve_vertices(int num_vertices)
+{
+	return graphics_reserve_polygon_edges(num_vertices) && tween_reserve(num_vertices);
 }
 
 void anim_set_xor(bool xor) {
@@ -93,39 +122,54 @@ void anim_set_multidraw_3d(bool enabled)
 	anim_multidraw_3d = enabled;
 }
 
-static uint8_t *anim_draw_object(struct Bitplane *, uint8_t *data);
+static uint8_t *anim_draw_object(struct Bitplane *, struct animation *anim, uint8_t *data);
+
+/* True if 'shape' is a polygon command, length and vertices all before 'end'. */
+static bool anim_polygon_within(uint8_t *shape, uint8_t *end)
+{
+	return shape + 2 <= end && shape + 2 + (shape[1] * 2) <= end;
+}
 void anim_draw(struct Bitplane *anim_bitplane, struct animation *anim, int frame_idx)
 {
 	if(frame_idx > anim->num_frames)
 		return;
 
+	anim->last_used = ++anim_clock;
+
 	int index = ((anim->indices[(frame_idx * 2)] << 8) | anim->indices[(frame_idx * 2) + 1]);
 	uint8_t *data = &(anim->data[index]);
 
-	/* Normally num_objects is between 1 and 6, but in the fake-3D section is goes up to 15. */
+	/* Normally num_objects is between 1 and 6, but in the fake-3D section is goes up to 15.
+	 * Any count is fine as long as the objects stay inside the block. */
 	//backend_debug("anim_draw frame %d\n", frame_idx);
-	uint8_t num_objects = *data++;
-	if(num_objects < 1 || num_objects > 16) {
-		backend_debug("anim_draw: num_objects: %d\n", num_objects);
+	if(data >= anim->past_data_end) {
+		backend_debug("anim_draw: frame %d outside block\n", frame_idx);
 		return;
 	}
 
+	uint8_t num_objects = *data++;
+
 	if(anim_multidraw_3d) {
-		planar_clear(&backend_bitplane[0]);
-		planar_clear(&backend_bitplane[1]);
-		planar_clear(&backend_bitplane[2]);
+		planar_clear_drawn(&backend_bitplane[0]);
+		planar_clear_drawn(&backend_bitplane[1]);
+		planar_clear_drawn(&backend_bitplane[2]);
 	} else {
-		planar_clear(anim_bitplane);
+		planar_clear_drawn(anim_bitplane);
 	}
 	
 
-	for(uint8_t i = 0; i < num_objects; i++) {
-		data = anim_draw_object(anim_bitplane, data);
+	for(uint8_t i = 0; i < num_objects && data; i++) {
+		data = anim_draw_object(anim_bitplane, anim, data);
 	}
 }
 
-static uint8_t *anim_draw_object(struct Bitplane *anim_bitplane, uint8_t *data) {
-	/* draw_cmd should be 0xdX for any X */
+static uint8_t *anim_draw_object(struct Bitplane *anim_bitplane, struct animation *anim, uint8_t *data) {
+	/* draw_cmd should be 0xdX for any X. Returns NULL if the object is bad. */
+	if(data + 2 > anim->past_data_end) {
+		backend_debug("anim object outside block\n");
+		return NULL;
+	}
+
 	uint8_t draw_cmd = *data++;
 	//
 	// It seems that the lower 4 bits of the draw command include extra
@@ -136,6 +180,11 @@ static uint8_t *anim_draw_object(struct Bitplane *anim_bitplane, uint8_t *data)
 		{
 			int num_vertices = *data++;
 			//backend_debug("draw cmd %x verts %d\n", draw_cmd, num_vertices);
+			if(data + (num_vertices * 2) > anim->past_data_end) {
+				backend_debug("anim polygon outside block\n");
+				return NULL;
+			}
+
 			if(num_vertices > 0) {
 
 				if(anim_multidraw_3d) {
@@ -171,23 +220,38 @@ static uint8_t *anim_draw_object(struct Bitplane *anim_bitplane, uint8_t *data)
 		case 0xe0: // e6 and e7 known
 		case 0xf0: // f2 known
 		{
+			if(data + 6 > anim->past_data_end) {
+				backend_debug("anim tween outside block\n");
+				return NULL;
+			}
+
 			uint8_t *tween_from = data;
 			uint8_t *tween_to   = data;
 
+			uint8_t *from_end = anim->past_data_end;
+
 			tween_from     -= ((data[0] << 8) + (data[1])); data += 2;
 			tween_to       += ((data[0] << 8) + (data[1])); data += 2;
 			int tween_t     = *data++; // position in tween
 			int tween_count = *data++;
 
-			if(tween_from < current_anim.data) {
-				// A tween referencing a previous animation. We boldly assume it is specifically referencing the previous
-				// block (which always happens in SOTA). split_and_compress.py ensures that tweens never reference beyond
-				// their current block, so this is the only other-block case.
-				ptrdiff_t offset = (uintptr_t)current_anim.data - (uintptr_t)tween_from; // How far before the start of the block?
-				tween_from = prev_anim.past_data_end - offset;
+			if(tween_from < anim->data) {
+				// A tween referencing an earlier block of a split animation.
+				tween_from = anim_resolve_before(anim, anim->data - tween_from, &from_end);
+				if(tween_from == NULL) {
+					backend_debug("tween source not resident\n");
+					break;
+				}
+			}
+
+			if(!anim_polygon_within(tween_from, from_end) || !anim_polygon_within(tween_to, anim->past_data_end)) {
+				backend_debug("anim tween shape outside block\n");
+				return NULL;
 			}
 
 			uint8_t *shape = lerp_tween(tween_from, tween_to, tween_t, tween_count);
+			if(shape == NULL)
+				break;
 
 			int num_vertices = *shape++;
 			if(anim_outline) {
@@ -199,79 +263,316 @@ static uint8_t *anim_draw_object(struct Bitplane *anim_bitplane, uint8_t *data)
 		}
 		default:
 			backend_debug("Unknown command %x\n", draw_cmd);
-			break;
+			return NULL;
 	}
 	return data;
 }
 
+/* Tweens morph between two polygons, possibly with different vertex counts,
+ * over tween_count steps. Each (from, to, count) gets a cache entry holding
+ * every point's position and per-step delta in 16.16 fixed point: position is
+ * always exactly base + delta * t, so moving to any step is an integer
+ * multiply-add per coordinate, and moving to the next step is a plain add. */
+struct tween {
+	uint8_t *from, *to; // key: the two draw commands...
+	int count;          // ...and the number of steps between them
+	int t;              // step currently held in pos
+	int points;
+	unsigned last_used;
+	int32_t *pos;   // tween_capacity points
+	int32_t *delta;
+};
+
+static struct tween tween_cache[TWEEN_CACHE_ENTRIES];
+static unsigned tween_clock;
+static int tween_capacity = 0; // in points
+
+/* Grow the tween buffers to hold shapes of at least this many points. */
+static bool tween_reserve(int points)
+{
+	if(points <= tween_capacity)
+		return true;
+
+	int capacity = points > tween_capacity * 2 ? points : tween_capacity * 2;
+
+	size_t old_size = tween_capacity * 2 * sizeof(int32_t);
+	size_t size = capacity * 2 * sizeof(int32_t);
+
+	/* Each buffer is replaced as soon as it's grown, so if we run out part way
+	 * everything still holds at least the old capacity. */
+	uint8_t *new_current_tween = backend_resize_reserved_memory(current_tween, current_tween ? 1 + tween_capacity * 2 : 0, 1 + capacity * 2);
+	if(new_current_tween == NULL)
+		return false;
+	current_tween = new_current_tween;
+
+	for(int i = 0; i < TWEEN_CACHE_ENTRIES; i++) {
+		struct tween *tween = &tween_cache[i];
+
+		tween->from = tween->to = NULL; // contents are gone
+
+		int32_t *pos = backend_resize_reserved_memory(tween->pos, old_size, size);
+		if(pos == NULL)
+			return false;
+		tween->pos = pos;
+
+		int32_t *delta = backend_resize_reserved_memory(tween->delta, old_size, size);
+		if(delta == NULL)
+			return false;
+		tween->delta = delta;
+	}
+
+	tween_capacity = capacity;
+
+	return true;
+}
+
+static void tween_cache_flush()
+{
+	for(int i = 0; i < TWEEN_CACHE_ENTRIES; i++) {
+		tween_cache[i].from = tween_cache[i].to = NULL;
+	}
+}
+
+/* Build the entry for step 0. The shape with fewer vertices is resampled so
+ * that output point i takes vertex i * length / points from each shape. */
+static void tween_prepare(struct tween *tween, uint8_t *tween_from, uint8_t *tween_to, int tween_count)
+{
+	int from_length = tween_from[1];
+	int to_length = tween_to[1];
+	uint8_t *from = tween_from + 2; // skip command and length
+	uint8_t *to = tween_to + 2;
+
+	int points = from_length > to_length ? from_length : to_length;
+	if(!tween_reserve(points)) {
+		backend_debug("tween: couldn't reserve %d points\n", points);
+		points = tween_capacity;
+	}
+
+	tween->from = tween_from;
+	tween->to = tween_to;
+	tween->count = tween_count;
+	tween->t = 0;
+	tween->points = (from_length && to_length) ? points : 0;
+
+	int steps = tween_count > 0 ? tween_count : 1;
+
+	for(int i = 0; i < tween->points; i++) {
+		int point_from = (i * from_length) / points;
+		int point_to = (i * to_length) / points;
+
+		for(int coord = 0; coord < 2; coord++) {
+			int32_t start = from[point_from * 2 + coord];
+			int32_t end = to[point_to * 2 + coord];
+
+			// Start half a unit up so that truncating the position rounds it.
+			tween->pos[i * 2 + coord] = (start * 65536) + 32768;
+			tween->delta[i * 2 + coord] = ((end - start) * 65536) / steps;
+		}
+	}
+}
+
+static struct tween *tween_find(uint8_t *tween_from, uint8_t *tween_to, int tween_count)
+{
+	struct tween *victim = &tween_cache[0];
+
+	for(int i = 0; i < TWEEN_CACHE_ENTRIES; i++) {
+		struct tween *tween = &tween_cache[i];
+
+		if(tween->from == tween_from && tween->to == tween_to && tween->count == tween_count)
+			return tween;
+
+		if(tween->last_used < victim->last_used)
+			victim = tween;
+	}
+
+	tween_prepare(victim, tween_from, tween_to, tween_count);
+	return victim;
+}
+
+/* Returns the vertex count followed by (y, x) pairs, valid until the next call,
+ * or NULL if there's no memory for it. Both shapes must be whole polygons. */
 uint8_t *lerp_tween(uint8_t *tween_from, uint8_t *tween_to, int tween_t, int tween_count)
 {
 	// We expect these to be draw commands (i.e. 0xd2) followed by lengths.
-	tween_from++; // skip command
-	tween_to++; 
+	struct tween *tween = tween_find(tween_from, tween_to, tween_count);
+	int coords = tween->points * 2;
 
-	int tween_from_length = *tween_from++;
-	int tween_to_length   = *tween_to++;
+	if(current_tween == NULL)
+		return NULL;
 
-	uint8_t *lerp_pos = current_tween;
+	tween->last_used = ++tween_clock;
+
+	if(tween_t == tween->t + 1) {
+		for(int i = 0; i < coords; i++)
+			tween->pos[i] += tween->delta[i];
+	} else if(tween_t != tween->t) {
+		int32_t steps = tween_t - tween->t;
+
+		for(int i = 0; i < coords; i++)
+			tween->pos[i] += tween->delta[i] * steps;
+	}
 
-	/* TODO this and the multiplier thing are pretty obviously broken */
-	int points = tween_from_length > tween_to_length ? tween_from_length: tween_to_length;
-	*(lerp_pos++)= points;
+	tween->t = tween_t;
 
-	float point_multiplier_from = (float)tween_from_length / points;
-	float point_multiplier_to   = (float)tween_to_length / points;
+	current_tween[0] = tween->points;
+	for(int i = 0; i < coords; i++)
+		current_tween[i + 1] = tween->pos[i] >> 16;
 
-	float amt = (float)tween_t / tween_count;
+	return current_tween;
+}
 
-	for(int i = 0; i < points; i++) {
-		int point_from = i * point_multiplier_from;
-		int point_to   = i * point_multiplier_to;
+/* Walk every frame of a block to find its largest polygon, so that buffers can
+ * be sized when the block is loaded rather than while drawing. Frames are
+ * stored back to back after the indices. */
+static int anim_max_vertices(struct animation *anim)
+{
+	int max_vertices = 0;
+	uint8_t *data = anim->data;
+
+	while(data < anim->past_data_end) {
+		int num_objects = *data++;
+
+		for(; num_objects && data + 2 <= anim->past_data_end; num_objects--) {
+			uint8_t draw_cmd = *data++;
+
+			switch(draw_cmd & 0xf0) {
+				case 0xd0:
+				{
+					int num_vertices = *data++;
+					if(num_vertices > max_vertices)
+						max_vertices = num_vertices;
+					data += num_vertices * 2;
+					break;
+				}
+				case 0xe0:
+				case 0xf0:
+					data += 6;
+					break;
+				default:
+					return max_vertices; // not frame data; stop here.
+			}
+		}
+	}
 
-		uint8_t from_y = tween_from[point_from * 2];
-		uint8_t from_x = tween_from[(point_from * 2) + 1];
-		uint8_t to_y = tween_to[point_to * 2];
-		uint8_t to_x = tween_to[(point_to * 2) + 1];
+	return max_vertices;
+}
 
-		*lerp_pos++ = from_y + (amt * (to_y - from_y));
-		*lerp_pos++ = from_x + (amt * (to_x - from_x));
+static struct animation *anim_window_find(int data_file)
+{
+	for(int i = 0; i < ANIM_WINDOW_BLOCKS; i++) {
+		if(anim_window[i].data_file == data_file)
+			return &anim_window[i];
 	}
 
-	return current_tween;
+	return NULL;
 }
 
-struct animation *anim_load(int data_file, int anim_idx) {
+/* Load a block into the window, evicting the least recently used block other
+ * than the one currently being played. */
+static struct animation *anim_window_load(int data_file, int prev_data_file)
+{
+	struct animation *anim = anim_window_find(data_file);
+
+	if(anim) {
+		if(prev_data_file != -1)
+			anim->prev_data_file = prev_data_file;
+		anim->last_used = ++anim_clock;
+		return anim;
+	}
+
+	struct animation *victim = NULL;
+	for(int i = 0; i < ANIM_WINDOW_BLOCKS; i++) {
+		struct animation *candidate = &anim_window[i];
+
+		if(candidate == playing_anim)
+			continue;
+
+		if(victim == NULL || candidate->data_file == -1 || (victim->data_file != -1 && candidate->last_used < victim->last_used))
+			victim = candidate;
+	}
+
+	if(victim == NULL)
+		return NULL;
+
+	if(victim->data_file != -1) {
+		backend_wad_unload_file(victim->indices - sizeof(uint16_t));
+
+		// Cached tweens are keyed by address, which may be reused once a file is unloaded.
+		tween_cache_flush();
+	}
+
+	victim->data_file = -1;
+	victim->indices = victim->data = victim->past_data_end = NULL;
+
 	/*
 	 * Format of an animation file
 	 * 2 bytes: number of indices
 	 * ...    : indices
 	 * ...    : animation data
 	*/
-	if(current_anim.data_file != data_file) {
-		if(prev_anim.data_file != -1) {
-			backend_wad_unload_file(prev_anim.data);
-		}
+	size_t size;
 
-		prev_anim = current_anim;
+	uint8_t *anim_file = backend_wad_load_file(data_file, &size);
+	if(anim_file == NULL) {
+		backend_debug("anim load fail\n");
+		return NULL;
+	}
 
-		current_anim.indices = current_anim.data = NULL;
+	victim->data_file = data_file;
+	victim->prev_data_file = prev_data_file;
+	victim->num_frames = anim_file[0] << 8 | anim_file[1];
+	victim->indices = anim_file + sizeof(uint16_t);
+	victim->data = victim->indices + (victim->num_frames * 2);
+	victim->past_data_end = anim_file + size;
+	victim->last_used = ++anim_clock;
 
-		size_t size;
+	int max_vertices = anim_max_vertices(victim);
+	graphics_reserve_polygon_edges(max_vertices);
+	tween_reserve(max_vertices);
 
-		uint8_t *anim_file = backend_wad_load_file(data_file, &size);
-		if(anim_file == NULL) {
-			backend_debug("anim load fail\n");
-			anim_destroy(&current_anim);
-			return NULL;
+	return victim;
+}
+
+/* Resolve a tween source 'offset' bytes before the start of anim's data. Split
+ * anims are cut from one long data stream, so this walks back through the
+ * blocks preceding anim, loading the immediately preceding one if need be. */
+static uint8_t *anim_resolve_before(struct animation *anim, ptrdiff_t offset, uint8_t **past_data_end)
+{
+	for(int depth = 1; depth < ANIM_WINDOW_BLOCKS && anim->prev_data_file != -1; depth++) {
+		struct animation *prev = anim_window_find(anim->prev_data_file);
+
+		if(prev == NULL && depth == 1)
+			prev = anim_window_load(anim->prev_data_file, -1);
+
+		if(prev == NULL)
+			break;
+
+		ptrdiff_t prev_length = prev->past_data_end - prev->data;
+		if(offset <= prev_length) {
+			*past_data_end = prev->past_data_end;
+			return prev->past_data_end - offset;
 		}
 
-		current_anim.num_frames = anim_file[0] << 8 | anim_file[1];
-		current_anim.indices = anim_file + sizeof(uint16_t);
-		current_anim.data = current_anim.indices + (current_anim.num_frames * 2);
-		current_anim.past_data_end = anim_file + size;
+		offset -= prev_length;
+		anim = prev;
 	}
 
-	return &current_anim;
+	return NULL;
+}
+
+struct animation *anim_load(int data_file, int prev_data_file) {
+	struct animation *anim = anim_window_load(data_file, prev_data_file);
+
+	playing_anim = anim;
+	return anim;
+}
+
+/* Get a block ready before the choreography switches to it. */
+void anim_prefetch(int data_file, int prev_data_file)
+{
+#if ANIM_WINDOW_BLOCKS > 2
+	anim_window_load(data_file, prev_data_file);
+#endif
 }
 
 int anim_destroy(struct animation *anim) {
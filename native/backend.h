@@ -9,10 +9,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/* Bounding box of everything drawn into a bitplane since it was last cleared,
+ * in pixels relative to 'data', inclusive. Empty when x1 < x0. */
+struct BitplaneExtent {
+	int x0, y0, x1, y1;
+};
+
 struct Bitplane {
 	int idx, width, height, stride;
 	uint8_t *data; // potentially offset
 	uint8_t *data_start; // unoffsetted data
+	struct BitplaneExtent drawn;
 };
 
 extern int window_width, window_height;
@@ -62,6 +69,10 @@ void backend_register_copper_func(void(*func)(int x, int y, uint32_t *palette));
  * This is to ensure that if the module can initialise, it will have enough
  * memory to run. */
 void *backend_reserve_memory(size_t size);
+/* Replace a reserved block (or NULL) with one of a new size, for buffers that
+ * grow with the data. The contents aren't kept. On failure, returns NULL and
+ * leaves the old block alone. */
+void *backend_resize_reserved_memory(void *mem, size_t old_size, size_t size);
 
 /* Palette manipulation. The external palette is uin32_t. */
 void backend_set_palette(int num_elements, uint32_t *elements);
@@ -79,11 +90,29 @@ int backend_font_get_height();
 
 /* WAD access. Data are loaded into the (heap.c) heap and ownership of the
  * memory is transferred to the caller. */
-/* Load choreography -- the choreography data is large so only load a scene at a time */
-void *backend_wad_load_choreography_for_scene_ms(int ms);
+/* Load choreography -- the choreography data is large so only load a scene at a time.
+ * size_out is set to the number of bytes of choreography available. */
+void *backend_wad_load_choreography_for_scene_ms(int ms, size_t *size_out);
+int backend_wad_get_file_count(void);
 /* Load a file */
 void *backend_wad_load_file(int file_idx, size_t *size_out);
 void backend_wad_unload_file(void *);
+#ifdef BACKEND_SUPPORTS_MANIFEST
+/* Hint that a file will be loaded soon, so the backend can start reading it. */
+void backend_wad_will_need_file(int file_idx);
+
+/* Whether a new scene's planes, 'width' x 'height' each (0 for none), fit in
+ * the bitplane memory, so that backend_allocate_bitplane won't give up. */
+bool backend_bitplanes_fit(const int width[6], const int height[6]);
+#endif
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+/* Save and restore the bitplanes and their contents, for seeking. The size
+ * changes as bitplanes are allocated. */
+size_t backend_snapshot_size(void);
+void backend_snapshot_save(void *dest);
+void backend_snapshot_restore(const void *src);
+#endif
 
 /* Random numbers */
 int backend_random();
@@ -0,0 +1,223 @@
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+#include "endian_compat.h"
+#include "blitter.h"
+#include "graphics.h"
+
+/* One row of a source channel, as seen by the inner loop. */
+struct channel_row {
+	const uint8_t *row;
+	int lo, hi; // bytes of the row the blit may read
+	int bit;    // source bit lined up with the start of the first D word
+	uint64_t dat;
+	bool enabled;
+};
+
+void blitter_op_init(struct blitter_op *op, struct Bitplane *d, int dx, int dy, int w, int h, uint8_t minterm)
+{
+	memset(op, 0, sizeof(*op));
+	op->d = d;
+	op->dx = dx;
+	op->dy = dy;
+	op->w = w;
+	op->h = h;
+	op->minterm = minterm;
+	op->fwm = ~0ULL;
+	op->lwm = ~0ULL;
+}
+
+void blitter_set_channel(struct blitter_channel *channel, struct Bitplane *plane, int x, int y)
+{
+	channel->plane = plane;
+	channel->x = x;
+	channel->y = y;
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return be64toh(value);
+}
+
+static inline void store_be64(uint8_t *p, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(p, &value, sizeof(value));
+}
+
+static inline uint64_t load_partial(const uint8_t *p, int num_bytes)
+{
+	uint64_t value = 0;
+	for(int i = 0; i < 8; i++)
+		value = (value << 8) | (i < num_bytes ? p[i] : 0);
+	return value;
+}
+
+static inline void store_partial(uint8_t *p, uint64_t value, int num_bytes)
+{
+	for(int i = 0; i < num_bytes; i++)
+		p[i] = value >> (56 - (i * 8));
+}
+
+static inline uint8_t channel_byte(const struct channel_row *ch, int idx)
+{
+	return (idx >= ch->lo && idx <= ch->hi) ? ch->row[idx] : 0;
+}
+
+/* 64 source bits starting at 'bit', which may be up to 7 bits before the
+ * channel's start. Bytes outside the blit read as zero (they're masked off
+ * anyway) so we never touch memory beyond the source rectangle. */
+static inline uint64_t channel_load(const struct channel_row *ch, int bit)
+{
+	if(!ch->enabled)
+		return ch->dat;
+
+	int idx = bit >= 0 ? bit / 8 : -((7 - bit) / 8);
+	int shift = bit - (idx * 8);
+	uint64_t value;
+
+	if(idx >= ch->lo && idx + (shift ? 8 : 7) <= ch->hi) {
+		value = load_be64(ch->row + idx);
+		if(shift)
+			value = (value << shift) | (ch->row[idx + 8] >> (8 - shift));
+		return value;
+	}
+
+	/* Partial word at a row end */
+	value = 0;
+	for(int i = 0; i < 8; i++)
+		value = (value << 8) | channel_byte(ch, idx + i);
+	if(shift)
+		value = (value << shift) | (channel_byte(ch, idx + 8) >> (8 - shift));
+	return value;
+}
+
+static inline void channel_row_init(struct channel_row *row, const struct blitter_channel *ch, bool used, int y, int w, int lead_bits)
+{
+	memset(row, 0, sizeof(*row));
+	row->enabled = used && ch->plane != NULL;
+	row->dat = ch->dat;
+	if(!row->enabled)
+		return;
+
+	row->row = ch->plane->data + ((ch->y + y) * ch->plane->stride);
+	row->lo = ch->x / 8;
+	row->hi = (ch->x + w - 1) / 8;
+	row->bit = ch->x - lead_bits;
+}
+
+static inline uint64_t minterm_apply(uint8_t minterm, uint64_t a, uint64_t b, uint64_t c)
+{
+	switch(minterm) {
+		case BLIT_MINTERM_A:
+			return a;
+		case BLIT_MINTERM_COOKIE:
+			return (a & b) | (~a & c);
+		case BLIT_MINTERM_A_XOR_C:
+			return a ^ c;
+		case BLIT_MINTERM_A_OR_C:
+			return a | c;
+		case BLIT_MINTERM_NOTA_AND_C:
+			return ~a & c;
+	}
+
+	uint64_t d = 0;
+	for(int i = 0; i < 8; i++) {
+		if(minterm & (1 << i))
+			d |= ((i & 4) ? a : ~a) & ((i & 2) ? b : ~b) & ((i & 1) ? c : ~c);
+	}
+	return d;
+}
+
+static void clip_channels(struct blitter_op *op, int xofs, int yofs)
+{
+	op->a.x += xofs; op->a.y += yofs;
+	op->b.x += xofs; op->b.y += yofs;
+	op->c.x += xofs; op->c.y += yofs;
+}
+
+void blitter_run(const struct blitter_op *op_in)
+{
+	struct blitter_op op = *op_in;
+	struct Bitplane *d = op.d;
+
+	/* Clip D to its plane; sources move with it. */
+	if(op.dx < 0) {
+		clip_channels(&op, -op.dx, 0);
+		op.w += op.dx;
+		op.dx = 0;
+	}
+	if(op.dy < 0) {
+		clip_channels(&op, 0, -op.dy);
+		op.h += op.dy;
+		op.dy = 0;
+	}
+	if(op.dx + op.w > d->width)
+		op.w = d->width - op.dx;
+	if(op.dy + op.h > d->height)
+		op.h = d->height - op.dy;
+	if(op.w <= 0 || op.h <= 0)
+		return;
+
+	/* Only fetch the sources the minterm actually depends on. */
+	uint8_t minterm = op.minterm;
+	bool use_a = (minterm >> 4) != (minterm & 0x0f);
+	bool use_b = ((minterm >> 2) & 0x33) != (minterm & 0x33);
+	bool use_c = ((minterm >> 1) & 0x55) != (minterm & 0x55);
+
+	/* D words are 8 bytes starting at the byte containing dx. */
+	int first_byte = op.dx / 8;
+	int lead_bits = op.dx % 8;
+	int row_bytes = ((op.dx + op.w - 1) / 8) - first_byte + 1;
+	int num_words = (row_bytes + 7) / 8;
+	int last_word_bytes = row_bytes - ((num_words - 1) * 8);
+	int end_bit = (lead_bits + op.w - 1) - ((num_words - 1) * 64);
+	uint64_t first_mask = ~0ULL >> lead_bits;
+	uint64_t last_mask = ~0ULL << (63 - end_bit);
+
+	int step = op.descending ? -1 : 1;
+	int y = op.descending ? op.h - 1 : 0;
+
+	for(int row = 0; row < op.h; row++, y += step) {
+		struct channel_row a, b, c;
+		channel_row_init(&a, &op.a, use_a, y, op.w, lead_bits);
+		channel_row_init(&b, &op.b, use_b, y, op.w, lead_bits);
+		channel_row_init(&c, &op.c, use_c, y, op.w, lead_bits);
+
+		uint8_t *drow = d->data + ((op.dy + y) * d->stride) + first_byte;
+		int word = op.descending ? num_words - 1 : 0;
+
+		for(int i = 0; i < num_words; i++, word += step) {
+			int bit = word * 64;
+			uint64_t mask = ~0ULL;
+			uint64_t aval = channel_load(&a, a.bit + bit);
+
+			if(word == 0) {
+				mask &= first_mask;
+				aval &= op.fwm;
+			}
+			if(word == num_words - 1) {
+				mask &= last_mask;
+				aval &= op.lwm;
+			}
+
+			uint64_t result = minterm_apply(minterm, aval,
+					channel_load(&b, b.bit + bit), channel_load(&c, c.bit + bit));
+
+			uint8_t *dst = drow + (word * 8);
+			if(word == num_words - 1 && last_word_bytes < 8) {
+				if(mask != ~0ULL)
+					result = (result & mask) | (load_partial(dst, last_word_bytes) & ~mask);
+				store_partial(dst, result, last_word_bytes);
+			} else {
+				if(mask != ~0ULL)
+					result = (result & mask) | (load_be64(dst) & ~mask);
+				store_be64(dst, result);
+			}
+		}
+	}
+
+	planar_extent_add(d, op.dx, op.dy, op.dx + op.w - 1, op.dy + op.h - 1);
+}
@@ -0,0 +1,38 @@
+#ifndef BLITTER_H
+#define BLITTER_H
+
+/* An Amiga-style blitter: D = minterm(A, B, C) over a rectangle, a 64-bit
+ * word at a time. Each source is barrel-shifted to line up with D. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "backend.h"
+
+/* Minterm bit (a << 2) | (b << 1) | c is the result for that combination of
+ * inputs, as on the Amiga. */
+#define BLIT_MINTERM_A          0xf0 // D = A
+#define BLIT_MINTERM_COOKIE     0xca // D = AB + ~AC: A is the mask, B the image, C the background
+#define BLIT_MINTERM_A_XOR_C    0x5a // D = A ^ C
+#define BLIT_MINTERM_A_OR_C     0xfa // D = A | C
+#define BLIT_MINTERM_NOTA_AND_C 0x0a // D = ~A & C
+
+struct blitter_channel {
+	struct Bitplane *plane; // NULL disables the channel, which then reads 'dat'
+	int x, y;
+	uint64_t dat;
+};
+
+struct blitter_op {
+	struct blitter_channel a, b, c;
+	struct Bitplane *d;
+	int dx, dy, w, h;
+	uint8_t minterm;
+	uint64_t fwm, lwm; // ANDed with A in the first and last D words of each row
+	bool descending; // last row and word first, for overlapping copies where D follows the source
+};
+
+void blitter_op_init(struct blitter_op *op, struct Bitplane *d, int dx, int dy, int w, int h, uint8_t minterm);
+void blitter_set_channel(struct blitter_channel *channel, struct Bitplane *plane, int x, int y);
+void blitter_run(const struct blitter_op *op);
+
+#endif // BLITTER_H
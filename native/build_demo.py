@@ -10,6 +10,7 @@ import math
 import argparse
 
 from wad import Wad
+from manifest import Manifest
 
 MS_PER_ANIM_FRAME = 40
 
@@ -934,6 +935,11 @@ def get_file(local_filename):
 	with open(local_filename, 'wb') as h:
 		h.write(gzip.decompress(result))
 
+def _add_file(name, state):
+	idx = state['wad'].add(name)
+	state['manifest'].use_file(idx)
+	return idx
+
 def encode_clear(args, state):
 	plane = args.get('plane', 'all')
 	if plane == 'all':
@@ -974,15 +980,27 @@ def encode_fadeto(args, state):
 
 	return ms_taken, struct.pack(ENDIAN + 'II', CMD_FADETO, ms) + encode_palette(args, state)[1]
 
-def encode_anim(args, state):
-	data_fn = 'data/%s_anim.bin' % (args['name'])
+def _add_anim_file(name, args, state):
+	data_fn = 'data/%s_anim.bin' % (name)
 	get_file(data_fn)
 
 	if 'transform_func' in args and data_fn not in state['wad']:
 		xformed = args['transform_func'](data_fn)
-		data_idx = state['wad'].add_bin(xformed, filename=data_fn)
+		idx = state['wad'].add_bin(xformed, filename=data_fn)
+	else:
+		idx = state['wad'].add(data_fn)
+
+	state['manifest'].use_anim(idx, state['wad'].data(idx))
+	return idx
+
+def encode_anim(args, state):
+	data_idx = _add_anim_file(args['name'], args, state)
+
+	# Split anims may tween from the block before this one.
+	if 'prev_name' in args:
+		prev_data_idx = _add_anim_file(args['prev_name'], args, state)
 	else:
-		data_idx = state['wad'].add(data_fn)
+		prev_data_idx = 0xffffffff
 
 	frame_from = args['from']
 	frame_to   = args['to']
@@ -990,7 +1008,7 @@ def encode_anim(args, state):
 	xor = args.get('xor', 1)
 
 	ms = state['msperframe'] * (1 + abs(frame_to - frame_from))
-	encoded = struct.pack(ENDIAN + 'IIHHHH', CMD_ANIM, data_idx, frame_from, frame_to, bitplane, xor)
+	encoded = struct.pack(ENDIAN + 'IIIHHHH', CMD_ANIM, data_idx, prev_data_idx, frame_from, frame_to, bitplane, xor)
 
 	return ms, encoded
 
@@ -1034,6 +1052,9 @@ def encode_split_anim(args, state):
 					'xor': args.get('xor', 1),
 					'plane': bitplane }
 
+			if idx > 0:
+				anim_args['prev_name'] = '%s-%02d' % (args['name'], idx - 1)
+
 			if 'transform_func' in args:
 				anim_args['transform_func'] = args['transform_func']
 
@@ -1068,10 +1089,10 @@ def encode_music(args, state):
 	if args['type'] == 'start':
 		if USE_MODS:
 			get_file(args['mod'])
-			packme = (CMD_MOD, 1, state['wad'].add(args['mod']))
+			packme = (CMD_MOD, 1, _add_file(args['mod'], state))
 		else:
 			get_file(args['mp3'])
-			packme = (CMD_MP3, 1, state['wad'].add(args['mp3']))
+			packme = (CMD_MP3, 1, _add_file(args['mp3'], state))
 	elif args['type'] == 'stop':
 		if USE_MODS:
 			packme = (CMD_MOD, 2, 0)
@@ -1082,7 +1103,7 @@ def encode_music(args, state):
 
 def encode_ilbm(args, state):
 	get_file(args['name'])
-	file_idx = state['wad'].add(args['name'])
+	file_idx = _add_file(args['name'], state)
 
 	# display type: fullscreen = 0, centre = 1
 	if 'display' in args:
@@ -1108,12 +1129,13 @@ def encode_mbit(args, state):
 	# mbit is a compressed planar file format used by the Pebble demo
 	get_file(args['name'])
 	file_idx = state['wad'].add(args['name'])
+	state['manifest'].use_mbit(file_idx, state['wad'].data(file_idx))
 
 	return 0, struct.pack(ENDIAN + 'II', CMD_MBIT, file_idx)
 
 def encode_sound(args, state):
 	get_file(args['name'])
-	file_idx = state['wad'].add(args['name'])
+	file_idx = _add_file(args['name'], state)
 
 	return 0, struct.pack(ENDIAN + 'II', CMD_SOUND, file_idx)
 
@@ -1223,18 +1245,23 @@ def encode_starteffect(args, state):
 	#files_packed = struct.pack(ENDIAN + ('I' * len(files_idx)), *files_idx)
 
 	# text block for VOTE! VOTE! VOTE! effect
+	heap_bytes = 0
 	if args['name'] == 'votevotevote':
 		args = pack_text_block(args.get('text', ()))
 	elif args['name'] == 'copperpastels':
+		# copied to the heap by scene_init_copperpastels()
+		heap_bytes = 4 + 4 * len(args.get('values', ()))
 		args = _pack_copperpastels(args.get('palette_fade_ref', -1), args.get('values', ()))
 	else:
 		args = b''
 
+	state['manifest'].use_effect(effect_num, heap_bytes)
+
 	return 0, struct.pack(ENDIAN + 'II', CMD_STARTEFFECT, effect_num) + args
 
 def encode_loadfont(args, state):
 	get_file(args['name'])
-	file_idx = state['wad'].add(args['name'])
+	file_idx = _add_file(args['name'], state)
 	startchar = ord(args['startchar'])
 	numchars = len(args['map']) // 4
 	fontmap = struct.pack(ENDIAN + ('H' * len(args['map'])), *args['map'])
@@ -1280,7 +1307,7 @@ class SceneIndexEntry:
 		for ms, _, name in self.scene_tuples:
 			print('  %-22s %d' % (name, ms))
 
-def get_demo_sequence(wad, choreography):
+def get_demo_sequence(wad, manifest, choreography):
 	# The time unit is milliseconds. Most animations run at 25fps or 40ms/frame.
 	# This can be changed if necessary using the 'msperframe' key of a 'scene' entry.
 
@@ -1290,9 +1317,11 @@ def get_demo_sequence(wad, choreography):
 	# This is literally a bag of stuff passed around between encoders. The
 	# scene command updates msperframe.
 	# wad: this wad
+	# manifest: what each scene needs, filled in as files and effects are used
 	# msperframe: the most recent msperframe, from scene, or 40
 	state = {
 			'wad': wad,
+			'manifest': manifest,
 			'msperframe': MS_PER_ANIM_FRAME,
 	} 
 
@@ -1392,6 +1421,10 @@ def get_demo_sequence(wad, choreography):
 	byte_position = 0
 	for entry in choreography:
 
+		if entry[0] == 'scene':
+			planes = tuple(entry[1]['planes']) + (BITPLANE_OFF,) * (6 - len(entry[1]['planes']))
+			manifest.start_scene(entry[1]['name'], previous_end, planes)
+
 		this_entry_ms, encoded_entry = encode_demo_entry(entry, state)
 		
 		this_start = previous_end
@@ -1431,11 +1464,14 @@ def get_demo_sequence(wad, choreography):
 
 	return b''.join(encoded)
 
-def build_demo(choreography, filename):
-	wad = Wad(ENDIAN)
-	encoded = get_demo_sequence(wad, choreography)
+def build_demo(choreography, filename, compress=False):
+	wad = Wad(ENDIAN, compress=compress)
+	manifest = Manifest(ENDIAN)
+	encoded = get_demo_sequence(wad, manifest, choreography)
 	print("Choreography length: %d bytes" %(len(encoded),))
 	wad.add_bin(encoded, is_choreography=True)
+	wad.add_bin(manifest.serialise(), is_manifest=True)
+	manifest.dump()
 
 	dirname = os.path.dirname(filename)
 	if dirname and not os.path.exists(dirname):
@@ -1448,9 +1484,10 @@ if __name__ == '__main__':
 	parser = argparse.ArgumentParser()
 	parser.add_argument('--modplug-bad-decoder', default=False, action='store_true', help="Work around libmodplug's buggy MOD player")
 	parser.add_argument('--mp3', default=False, action='store_true', help='Use MP3s instead of MODs')
+	parser.add_argument('--compress', default=False, action='store_true', help='Compress files in the WAD (not for Pebble)')
 	args = parser.parse_args()
 
 	USE_MODS = not args.mp3
 
-	build_demo(DEMO, 'sota.wad')
+	build_demo(DEMO, 'sota.wad', compress=args.compress)
 
@@ -8,6 +8,7 @@
 #include "anim.h"
 #include "scene.h"
 #include "mbit.h"
+#include "palette.h"
 
 #ifdef BACKEND_SUPPORTS_SOUND
 #include "sound.h"
@@ -17,10 +18,39 @@
 #include "iff.h"
 #endif
 
+#ifdef BACKEND_SUPPORTS_PREFETCH
+#include "prefetch.h"
+
+// How far ahead to look for work to prepare in the background
+#define PREFETCH_LOOKAHEAD_COMMANDS 64
+#define PREFETCH_LOOKAHEAD_JOBS 4
+#endif
+
+#ifdef BACKEND_SUPPORTS_MANIFEST
+#include "manifest.h"
+#include "tinf/src/tinf.h"
+#endif
+
 #include "backend.h"
+#include "heap.h"
 #include "choreography.h"
 #include "choreography_commands.h"
 
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+#include <stdlib.h>
+#include "align.h"
+
+// Take a snapshot for seeking this often during playback...
+#ifndef SNAPSHOT_INTERVAL_MS
+#define SNAPSHOT_INTERVAL_MS 2000
+#endif
+
+// ...keeping at most this many, replacing the oldest.
+#ifndef SNAPSHOT_COUNT
+#define SNAPSHOT_COUNT 32
+#endif
+#endif
+
 #define SOUND_START 1
 #define SOUND_STOP 2
 
@@ -34,6 +64,9 @@
 
 #define SCENE_ONION_SKIN 0x40
 
+// How far ahead cmd_anim looks for the next animation block.
+#define ANIM_LOOKAHEAD_COMMANDS 32
+
 #define BITPLANE_OFF 0
 #define BITPLANE_1X1 1
 #define BITPLANE_2X1 2
@@ -72,6 +105,7 @@ struct choreography_fadeto {
 struct choreography_anim {
 	struct choreography_header header;
 	uint32_t data_file;
+	uint32_t prev_data_file; // preceding block of a split anim, or 0xffffffff
 	uint16_t frame_from;
 	uint16_t frame_to;
 	uint16_t bitplane;
@@ -152,11 +186,25 @@ struct choreography_end {
 	uint32_t end_of_scene;
 };
 
-static uint8_t *choreography;
-static struct choreography_header *pos;
+/* The choreography compiled into a flat, validated list of commands. */
+struct timeline_entry {
+	uint32_t start_ms;
+	void (*handler)(int ms, struct choreography_header *header);
+	struct choreography_header *payload;
+};
+
+static struct timeline_entry *timeline;
+static int timeline_length; // timeline[timeline_length] is always a CMD_END, which is never run
+static int timeline_pos;
+#ifdef BACKEND_SUPPORTS_PREFETCH
+static int prefetch_scanned_pos = -1; // timeline_pos at the last lookahead; -1 after a jump
+#endif
+
+// Terminates timelines which don't finish with the end of the demo.
+static struct choreography_end timeline_end = {{0xffffffff, sizeof(struct choreography_end), CMD_END}, 0};
 
 /* Things which may be happening. */
-static struct {
+static struct choreography_state {
 	// animations
 	struct animation *current_animation; // the anim data
 	struct choreography_anim current_animation_info; // the choreography data (copied)
@@ -180,6 +228,7 @@ static struct {
 	uint32_t fade_count;
 	int fade_start_ms;
 	int fade_end_ms;
+	struct palette_fade fade;
 
 	// pausing
 	int pause_end_ms;
@@ -187,17 +236,23 @@ static struct {
 	// effects
 	void (*effect_tick)(int ms);
 	void (*effect_deinit)();
+
+	// The commands which set up what's running, so it can be set up again after a seek
+	struct choreography_starteffect *effect_cmd;
+	int effect_heap_location; // heap location before the effect initialised
+	struct choreography_loadfont *loadfont_cmd;
+	struct choreography_scene_options *scene_options_cmd; // NULL for the scene defaults
 } state;
 
-static inline struct choreography_header *next_header(struct choreography_header *current_header)
-{
-	return (struct choreography_header *)(((uint8_t *)current_header) + current_header->length);
-}
+static int base_heap_location; // heap location before the choreography started
 
 bool choreography_init()
 {
-	choreography = NULL;
-	pos = NULL;
+	timeline = NULL;
+	timeline_length = timeline_pos = 0;
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	prefetch_scanned_pos = -1;
+#endif
 
 	state.current_animation = NULL;
 	state.current_animation_info.data_file = 0xffffffff;
@@ -207,6 +262,9 @@ bool choreography_init()
 	state.pause_end_ms = 0;
 
 	state.effect_deinit = state.effect_tick = NULL;
+	state.effect_cmd = NULL;
+	state.loadfont_cmd = NULL;
+	state.scene_options_cmd = NULL;
 	state.anim_3_behind_plane_1 = false;
 	state.anim_bitplane = 0;
 	state.epilepsy = false;
@@ -236,7 +294,7 @@ static void cmd_palette(struct choreography_palette *palette) {
 	/* Turn off any running fades */
 	state.fade_count = 0;
 	
-	backend_set_palette(palette->count, palette->values);
+	palette_set(palette->count, palette->values);
 }
 
 static void cmd_alternate_palette(struct choreography_alternate_palette *alternate) {
@@ -252,7 +310,7 @@ static void cmd_alternate_palette(struct choreography_alternate_palette *alterna
 static void cmd_use_alternate_palette(struct choreography_use_alternate_palette *alternate) {
 	uint32_t *src = alternate->alternate_idx == 0 ? state.fade_from : state.fade_to;
 
-	backend_set_palette(32, src);
+	palette_set(32, src);
 }
 
 static void _fade_to(int start_ms, int end_ms, int count, uint32_t *palette)
@@ -261,25 +319,56 @@ static void _fade_to(int start_ms, int end_ms, int count, uint32_t *palette)
 	state.fade_end_ms = end_ms;
 	state.fade_count = count;
 
-	backend_get_palette(32, state.fade_from);
+	palette_get(32, state.fade_from);
 	memcpy(state.fade_to, palette, count * sizeof(uint32_t));
 
 	if(count < 32) {
 		memset(&state.fade_to[count], 0, (32 - count) * sizeof(uint32_t));
 	}
+
+	palette_fade_init(&state.fade, count, state.fade_from, state.fade_to, end_ms - start_ms);
 }
 
 static void cmd_fadeto(struct choreography_fadeto *fadeto) {
 	_fade_to(fadeto->header.start_ms, fadeto->header.start_ms + fadeto->ms, fadeto->count, fadeto->values);
 }
 
+static inline int anim_file_idx(uint32_t data_file)
+{
+	return data_file == 0xffffffff ? -1 : (int)data_file;
+}
+
+/* Prepare the next block the choreography will switch to, if any is coming up soon. */
+static void prefetch_next_anim(struct choreography_anim *anim)
+{
+	int last = timeline_pos + ANIM_LOOKAHEAD_COMMANDS;
+	if(last > timeline_length)
+		last = timeline_length;
+
+	for(int i = timeline_pos + 1; i < last; i++) {
+		struct choreography_header *header = timeline[i].payload;
+
+		if(header->cmd == CMD_END)
+			break;
+
+		if(header->cmd == CMD_ANIM) {
+			struct choreography_anim *next = (struct choreography_anim *)header;
+
+			if(next->data_file != anim->data_file) {
+				anim_prefetch(anim_file_idx(next->data_file), anim_file_idx(next->prev_data_file));
+				break;
+			}
+		}
+	}
+}
+
 static void cmd_anim(struct choreography_anim *anim) {
 	// Unload the current animation if it's different.
 	if(state.current_animation_info.data_file != anim->data_file) {
 		anim_destroy(state.current_animation);
 	}
 
-	state.current_animation = anim_load(anim->data_file, 0);
+	state.current_animation = anim_load(anim_file_idx(anim->data_file), anim_file_idx(anim->prev_data_file));
 	state.current_animation_info = *anim;
 	state.last_drawn_frame = 0xffff;
 	state.animation_is_running = true;
@@ -299,17 +388,20 @@ static void cmd_anim(struct choreography_anim *anim) {
 
 	state.anim_bitplane = anim->bitplane;
 	anim_set_xor(anim->xor);
+
+	prefetch_next_anim(anim);
 }
 
 static void cmd_pause(struct choreography_pause *pause) {
-	state.pause_end_ms = pause->end_ms;
+	/* Pauses are currently encoded without an end time. */
+	state.pause_end_ms = pause->header.length >= sizeof(struct choreography_pause) ? pause->end_ms : pause->header.start_ms;
 }
 
 static void cmd_mod(struct choreography_mod *mod) {
 #ifdef BACKEND_SUPPORTS_SOUND
 	switch(mod->subcmd) {
 		case SOUND_START:
-			sound_mod_play(mod->arg);
+			sound_mod_play(mod->arg, mod->header.start_ms);
 			break;
 		case SOUND_STOP:
 			sound_mod_stop();
@@ -322,7 +414,7 @@ static void cmd_mp3(struct choreography_mod *mod) {
 #ifdef BACKEND_SUPPORTS_SOUND
 	switch(mod->subcmd) {
 		case SOUND_START:
-			sound_mp3_play(mod->arg);
+			sound_mp3_play(mod->arg, mod->header.start_ms);
 			break;
 		case SOUND_STOP:
 			sound_mp3_stop();
@@ -331,34 +423,66 @@ static void cmd_mp3(struct choreography_mod *mod) {
 #endif
 }
 
-static void cmd_ilbm(struct choreography_ilbm *ilbm) {
 #ifdef BACKEND_SUPPORTS_ILBM
-	// we re-use the fade-to palette for the image palette
-	struct LoadedIff iff;
-
-	/* Work out dimensions based on target bitplane width and height */
-	struct Bitplane *target_bitplane = &backend_bitplane[ilbm->plane];
-	int x = ilbm->x * target_bitplane->width / 240;
-	int y = ilbm->y * target_bitplane->height / 240;
-	int w = ilbm->w * target_bitplane->width / 240;
-	int h = ilbm->h * target_bitplane->height / 240;
-
-	iff_load(ilbm->file_idx, &iff);
-	iff_display(&iff, x, y, w, h, &(state.fade_count), state.fade_to, backend_bitplane, ilbm->plane);
-	iff_unload(&iff);
+/* Work out dimensions based on target bitplane width and height */
+static void ilbm_rect(struct choreography_ilbm *ilbm, int width, int height, int *x, int *y, int *w, int *h)
+{
+	*x = ilbm->x * width / 240;
+	*y = ilbm->y * height / 240;
+	*w = ilbm->w * width / 240;
+	*h = ilbm->h * height / 240;
+}
 
+/* Set, or start fading to, the image palette left in fade_to. */
+static void ilbm_show_palette(struct choreography_ilbm *ilbm)
+{
 	if(ilbm->fade_in_ms == 0) {
-		backend_set_palette(state.fade_count, state.fade_to);
+		palette_set(state.fade_count, state.fade_to);
 		state.fade_count = 0; 
 	} else {
 		/* lerp to palette */
-		backend_get_palette(32, state.fade_from);
+		palette_get(32, state.fade_from);
 
 		state.fade_start_ms = ilbm->header.start_ms;
 		state.fade_end_ms = ilbm->header.start_ms + ilbm->fade_in_ms;
+		palette_fade_init(&state.fade, state.fade_count, state.fade_from, state.fade_to, ilbm->fade_in_ms);
+	}
+}
+#endif
+
+static void cmd_ilbm(struct choreography_ilbm *ilbm) {
+#ifdef BACKEND_SUPPORTS_ILBM
+	// we re-use the fade-to palette for the image palette
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	if(!prefetch_apply_ilbm(ilbm, backend_bitplane, ilbm->plane, &state.fade_count, state.fade_to))
+#endif
+	{
+		struct LoadedIff iff;
+		struct Bitplane *target_bitplane = &backend_bitplane[ilbm->plane];
+		int x, y, w, h;
 
-		// Everything else has been done for us above.
+		ilbm_rect(ilbm, target_bitplane->width, target_bitplane->height, &x, &y, &w, &h);
+
+		iff_load(ilbm->file_idx, &iff);
+		iff_display(&iff, x, y, w, h, &(state.fade_count), state.fade_to, backend_bitplane, ilbm->plane, heap_frame_alloc(iff_scratch_size(&iff)));
+		iff_unload(&iff);
+	}
+
+	ilbm_show_palette(ilbm);
+#endif
+}
+
+/* cmd_ilbm for an image which will be cleared before anyone sees it. */
+static void cmd_ilbm_palette_only(struct choreography_ilbm *ilbm) {
+#ifdef BACKEND_SUPPORTS_ILBM
+	struct LoadedIff iff;
+
+	if(iff_load(ilbm->file_idx, &iff)) {
+		iff_get_palette(&iff, &state.fade_count, state.fade_to);
+		iff_unload(&iff);
 	}
+
+	ilbm_show_palette(ilbm);
 #endif
 }
 
@@ -371,9 +495,24 @@ static void cmd_sound(struct choreography_sound *sound) {
 static void cmd_mbit(struct choreography_mbit *mbit) {
 	size_t size;
 
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	if(prefetch_apply_mbit(mbit, backend_bitplane))
+		return;
+#endif
+
 	uint8_t *data = backend_wad_load_file(mbit->file_idx, &size);
 	if(data) {
-		mbit_display(data, &backend_set_palette, backend_bitplane);
+		mbit_display(data, &palette_set, backend_bitplane);
+		backend_wad_unload_file(data);
+	}
+}
+
+/* cmd_mbit for an image which will be cleared before anyone sees it. */
+static void cmd_mbit_palette_only(struct choreography_mbit *mbit) {
+	uint8_t *data = backend_wad_load_file(mbit->file_idx, NULL);
+
+	if(data) {
+		mbit_set_palette(data, &palette_set);
 		backend_wad_unload_file(data);
 	}
 }
@@ -386,6 +525,9 @@ static void cmd_starteffect(int ms, struct choreography_starteffect *effect) {
 		state.effect_tick = state.effect_deinit = NULL;
 	}
 
+	state.effect_cmd = effect;
+	state.effect_heap_location = heap_get_location();
+
 	switch(effect->effect_num) {
 		case EFFECT_NOTHING:
 			break;
@@ -426,6 +568,7 @@ static void cmd_starteffect(int ms, struct choreography_starteffect *effect) {
 }
 
 static void cmd_loadfont(int ms, struct choreography_loadfont *loadfont) {
+	state.loadfont_cmd = loadfont;
 	backend_font_load(loadfont->file_idx, loadfont->startchar, loadfont->numchars, loadfont->positions);
 }
 
@@ -442,25 +585,52 @@ static void cmd_scene_options(int ms, struct choreography_scene_options *scene_o
 	state.epilepsy_last_frame = false;
 }
 
+/* The size of a plane in the given BITPLANE_* style. Returns false, with a
+ * size of 0x0, if the plane is off. */
+static bool bitplane_style_size(uint8_t style, int *width, int *height)
+{
+	switch(style) {
+		case BITPLANE_1X1:
+			*width = window_width;
+			*height = window_height;
+			return true;
+		case BITPLANE_2X1:
+			*width = window_width * 2;
+			*height = window_height;
+			return true;
+		case BITPLANE_2X2:
+			*width = window_width * 2;
+			*height = window_height * 2;
+			return true;
+	}
+
+	*width = *height = 0;
+	return false;
+}
+
 static void cmd_scene(int ms, struct choreography_scene *scene) {
-	/* Initialise bitplanes */
-	backend_set_new_scene();
+	int width[6], height[6];
+	bool planes_fit = true;
+
 	for(int i = 0; i < 6; i++) {
-		switch(scene->bitplane_style[i]) {
-			case BITPLANE_OFF:
-				break;
-			case BITPLANE_1X1:
-				backend_allocate_bitplane(i, window_width, window_height);
-				break;
-			case BITPLANE_2X1:
-				backend_allocate_bitplane(i, window_width * 2, window_height);
-				break;
-			case BITPLANE_2X2:
-				backend_allocate_bitplane(i, window_width * 2, window_height * 2);
-				break;
-			default:
-				backend_debug("Unknown bitplane style\n");
-				break;
+		if(!bitplane_style_size(scene->bitplane_style[i], &width[i], &height[i]) && scene->bitplane_style[i] != BITPLANE_OFF)
+			backend_debug("Unknown bitplane style\n");
+	}
+
+#ifdef BACKEND_SUPPORTS_MANIFEST
+	/* The pool was sized from the manifest. If it's out of date, keep the
+	 * old planes rather than run out of pool part way through allocating. */
+	planes_fit = backend_bitplanes_fit(width, height);
+	if(!planes_fit)
+		backend_debug("scene at %u ms: its bitplanes don't fit the pool (is the manifest stale?), keeping the previous ones\n", scene->header.start_ms);
+#endif
+
+	/* Initialise bitplanes */
+	if(planes_fit) {
+		backend_set_new_scene();
+		for(int i = 0; i < 6; i++) {
+			if(width[i])
+				backend_allocate_bitplane(i, width[i], height[i]);
 		}
 	}
 
@@ -477,88 +647,330 @@ static void cmd_scene(int ms, struct choreography_scene *scene) {
 	null_scene_options.flags = 0;
 
 	cmd_scene_options(ms, &null_scene_options);
+	state.scene_options_cmd = NULL;
+
+#ifdef BACKEND_SUPPORTS_MANIFEST
+	/* Say now if the scene's effects and mbits won't fit, rather than
+	 * failing somewhere in the middle of it. */
+	const struct manifest_scene *manifest = manifest_find_scene(scene->header.start_ms);
+	if(manifest) {
+		size_t needed = manifest->effect_heap_bytes;
+		if(manifest->mbit_bytes)
+			needed += tinf_data_size() + manifest->mbit_bytes;
+
+		if(needed > heap_avail())
+			backend_debug("scene at %u ms needs %zu bytes of heap, only %zu available\n", scene->header.start_ms, needed, heap_avail());
+	}
+
+	/* Start reading what the next scene uses while this one plays. */
+	const struct manifest_scene *next = manifest_find_next_scene(scene->header.start_ms);
+	if(next) {
+		for(uint32_t i = 0; i < next->num_files; i++)
+			backend_wad_will_need_file(next->files[i]);
+	}
+#endif
 }
 
-// Create the state item at 'pos' without advancing it.
-static void create_state_item(int ms, struct choreography_header *pos)
+static void cmd_end(int ms, struct choreography_header *header)
 {
-	switch(pos->cmd) {
-		case CMD_END:
-			/* Nothing to do and don't advance */
-			break;
-		case CMD_CLEAR:
-			cmd_clear((struct choreography_clear *)pos);
-			break;
-		case CMD_PALETTE:
-			cmd_palette((struct choreography_palette *)pos);
-			break;
-		case CMD_ALTERNATE_PALETTE:
-			cmd_alternate_palette((struct choreography_alternate_palette *)pos);
-			break;
-		case CMD_USE_ALTERNATE_PALETTE:
-			cmd_use_alternate_palette((struct choreography_use_alternate_palette *)pos);
-			break;
-		case CMD_FADETO:
-			cmd_fadeto((struct choreography_fadeto *)pos);
-			break;
-		case CMD_ANIM:
-			cmd_anim((struct choreography_anim *)pos);
-			break;
-		case CMD_PAUSE:
-			cmd_pause((struct choreography_pause *)pos);
-			break;
-		case CMD_MOD:
-			cmd_mod((struct choreography_mod *)pos);
-			break;
-		case CMD_MP3:
-			cmd_mp3((struct choreography_mod *)pos);
-			break;
-		case CMD_ILBM:
-			cmd_ilbm((struct choreography_ilbm *)pos);
-			break;
-		case CMD_SOUND:
-			cmd_sound((struct choreography_sound *)pos);
-			break;
-		case CMD_STARTEFFECT:
-			cmd_starteffect(ms, (struct choreography_starteffect *)pos);
-			break;
-		case CMD_LOADFONT:
-			cmd_loadfont(ms, (struct choreography_loadfont *)pos);
-			break;
-		case CMD_SCENE:
-			cmd_scene(ms, (struct choreography_scene *)pos);
-			break;
-		case CMD_SCENE_INDEX:
-			// Ignored during playback
-			break;
-		case CMD_MBIT:
-			cmd_mbit((struct choreography_mbit *)pos);
-			break;
-		case CMD_SCENE_OPTIONS:
-			cmd_scene_options(ms, (struct choreography_scene_options *)pos);
+}
+
+/* Adapt the command functions to the timeline's handler signature. */
+#define TIMELINE_HANDLER(fn, type) \
+	static void timeline_##fn(int ms, struct choreography_header *header) { fn((struct type *)header); }
+#define TIMELINE_HANDLER_MS(fn, type) \
+	static void timeline_##fn(int ms, struct choreography_header *header) { fn(ms, (struct type *)header); }
+
+TIMELINE_HANDLER(cmd_clear, choreography_clear)
+TIMELINE_HANDLER(cmd_palette, choreography_palette)
+TIMELINE_HANDLER(cmd_alternate_palette, choreography_alternate_palette)
+TIMELINE_HANDLER(cmd_use_alternate_palette, choreography_use_alternate_palette)
+TIMELINE_HANDLER(cmd_fadeto, choreography_fadeto)
+TIMELINE_HANDLER(cmd_anim, choreography_anim)
+TIMELINE_HANDLER(cmd_pause, choreography_pause)
+TIMELINE_HANDLER(cmd_mod, choreography_mod)
+TIMELINE_HANDLER(cmd_mp3, choreography_mod)
+TIMELINE_HANDLER(cmd_ilbm, choreography_ilbm)
+TIMELINE_HANDLER(cmd_sound, choreography_sound)
+TIMELINE_HANDLER(cmd_mbit, choreography_mbit)
+TIMELINE_HANDLER_MS(cmd_starteffect, choreography_starteffect)
+TIMELINE_HANDLER_MS(cmd_loadfont, choreography_loadfont)
+TIMELINE_HANDLER_MS(cmd_scene, choreography_scene)
+
+static void timeline_cmd_scene_options(int ms, struct choreography_header *header)
+{
+	cmd_scene_options(ms, (struct choreography_scene_options *)header);
+	state.scene_options_cmd = (struct choreography_scene_options *)header;
+}
+
+/* Validation beyond the length check. 'num_files' is the number of files in the wad. */
+static inline bool valid_file(uint32_t file_idx, int num_files)
+{
+	return file_idx < (uint32_t)num_files;
+}
+
+static inline bool valid_plane(uint32_t plane)
+{
+	return plane < 6;
+}
+
+static bool validate_clear(struct choreography_header *header, int num_files)
+{
+	uint32_t plane = ((struct choreography_clear *)header)->plane;
+	return plane == 0xff || valid_plane(plane);
+}
+
+static bool validate_palette(struct choreography_header *header, int num_files)
+{
+	return ((struct choreography_palette *)header)->count <= 32;
+}
+
+static bool validate_fadeto(struct choreography_header *header, int num_files)
+{
+	return ((struct choreography_fadeto *)header)->count <= 32;
+}
+
+static bool validate_anim(struct choreography_header *header, int num_files)
+{
+	struct choreography_anim *anim = (struct choreography_anim *)header;
+	return valid_file(anim->data_file, num_files)
+		&& (anim->prev_data_file == 0xffffffff || valid_file(anim->prev_data_file, num_files))
+		&& valid_plane(anim->bitplane);
+}
+
+static bool validate_music(struct choreography_header *header, int num_files)
+{
+	struct choreography_mod *mod = (struct choreography_mod *)header;
+	return mod->subcmd != SOUND_START || valid_file(mod->arg, num_files);
+}
+
+static bool validate_ilbm(struct choreography_header *header, int num_files)
+{
+	struct choreography_ilbm *ilbm = (struct choreography_ilbm *)header;
+	return valid_file(ilbm->file_idx, num_files) && valid_plane(ilbm->plane);
+}
+
+static bool validate_sound(struct choreography_header *header, int num_files)
+{
+	return valid_file(((struct choreography_sound *)header)->file_idx, num_files);
+}
+
+static bool validate_mbit(struct choreography_header *header, int num_files)
+{
+	return valid_file(((struct choreography_mbit *)header)->file_idx, num_files);
+}
+
+static bool validate_starteffect(struct choreography_header *header, int num_files)
+{
+	struct choreography_starteffect *effect = (struct choreography_starteffect *)header;
+	size_t length = header->length - sizeof(struct choreography_starteffect);
+
+	switch(effect->effect_num) {
+		case EFFECT_VOTEVOTEVOTE:
+			return scene_votevotevote_data_valid(effect->effect_data, length);
+		case EFFECT_COPPERPASTELS:
+			return scene_copperpastels_data_valid(effect->effect_data, length);
+	}
+
+	return true;
+}
+
+static bool validate_loadfont(struct choreography_header *header, int num_files)
+{
+	struct choreography_loadfont *loadfont = (struct choreography_loadfont *)header;
+
+	/* Four positions (sx, sy, ex, ey) per character */
+	return valid_file(loadfont->file_idx, num_files)
+		&& loadfont->numchars > 0
+		&& loadfont->numchars <= (header->length - sizeof(struct choreography_loadfont)) / (4 * sizeof(uint16_t));
+}
+
+static bool validate_alternate_palette(struct choreography_header *header, int num_files)
+{
+	return ((struct choreography_alternate_palette *)header)->alternate_idx < 2;
+}
+
+static bool validate_use_alternate_palette(struct choreography_header *header, int num_files)
+{
+	return ((struct choreography_use_alternate_palette *)header)->alternate_idx < 2;
+}
+
+static bool validate_scene_options(struct choreography_header *header, int num_files)
+{
+	return ((struct choreography_scene_options *)header)->zoom >= 1;
+}
+
+static bool validate_scene(struct choreography_header *header, int num_files)
+{
+	struct choreography_scene *scene = (struct choreography_scene *)header;
+
+	for(int i = 0; i < 6; i++) {
+		if(scene->bitplane_style[i] > BITPLANE_2X2)
+			return false;
+	}
+
+	return header->length >= sizeof(struct choreography_scene) + scene->name_length;
+}
+
+/* Indexed by command number. Commands without a handler are dropped at compile time. */
+static const struct {
+	size_t min_length;
+	void (*handler)(int ms, struct choreography_header *header);
+	bool (*validate)(struct choreography_header *header, int num_files);
+} commands[] = {
+	[CMD_END] = {sizeof(struct choreography_end), cmd_end, NULL},
+	[CMD_CLEAR] = {sizeof(struct choreography_clear), timeline_cmd_clear, validate_clear},
+	[CMD_PALETTE] = {sizeof(struct choreography_palette), timeline_cmd_palette, validate_palette},
+	[CMD_FADETO] = {sizeof(struct choreography_fadeto), timeline_cmd_fadeto, validate_fadeto},
+	[CMD_ANIM] = {sizeof(struct choreography_anim), timeline_cmd_anim, validate_anim},
+	[CMD_PAUSE] = {sizeof(struct choreography_header), timeline_cmd_pause, NULL},
+	[CMD_MOD] = {sizeof(struct choreography_mod), timeline_cmd_mod, validate_music},
+	[CMD_ILBM] = {sizeof(struct choreography_ilbm), timeline_cmd_ilbm, validate_ilbm},
+	[CMD_SOUND] = {sizeof(struct choreography_sound), timeline_cmd_sound, validate_sound},
+	[CMD_STARTEFFECT] = {sizeof(struct choreography_starteffect), timeline_cmd_starteffect, validate_starteffect},
+	[CMD_LOADFONT] = {sizeof(struct choreography_loadfont), timeline_cmd_loadfont, validate_loadfont},
+	[CMD_ALTERNATE_PALETTE] = {sizeof(struct choreography_alternate_palette), timeline_cmd_alternate_palette, validate_alternate_palette},
+	[CMD_USE_ALTERNATE_PALETTE] = {sizeof(struct choreography_use_alternate_palette), timeline_cmd_use_alternate_palette, validate_use_alternate_palette},
+	[CMD_SCENE] = {sizeof(struct choreography_scene), timeline_cmd_scene, validate_scene},
+	[CMD_SCENE_INDEX] = {sizeof(struct choreography_scene_index), NULL, NULL}, // only used for seeking
+	[CMD_MBIT] = {sizeof(struct choreography_mbit), timeline_cmd_mbit, validate_mbit},
+	[CMD_SCENE_OPTIONS] = {sizeof(struct choreography_scene_options), timeline_cmd_scene_options, validate_scene_options},
+	[CMD_MP3] = {sizeof(struct choreography_mod), timeline_cmd_mp3, validate_music},
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/* Walk 'size' bytes of choreography, checking each command. If 'out' is
+ * non-NULL, write the runnable ones there. Returns the number of runnable
+ * commands, and the command which ends the timeline in *end_out. */
+static int timeline_compile(uint8_t *data, size_t size, int num_files, struct timeline_entry *out, struct choreography_header **end_out)
+{
+	uint8_t *end = data + size;
+	int count = 0;
+
+	*end_out = &timeline_end.header;
+
+	while(end - data >= (ptrdiff_t)sizeof(struct choreography_header)) {
+		struct choreography_header *header = (struct choreography_header *)data;
+
+		if(header->length < sizeof(struct choreography_header) || header->length > end - data) {
+			if(!out)
+				backend_debug("Choreography command %x at %u has bad length %u\n",
+						(unsigned int)header->cmd, (unsigned int)header->start_ms, (unsigned int)header->length);
 			break;
-		default:
-			/* This is bad */
-			backend_debug("Unknown choreography command %x\n", (unsigned int)(pos->cmd));
+		}
+		data += header->length;
+
+		if(header->cmd >= NUM_COMMANDS || commands[header->cmd].min_length == 0) {
+			if(!out)
+				backend_debug("Unknown choreography command %x\n", (unsigned int)(header->cmd));
+			continue;
+		}
+
+		if(header->length < commands[header->cmd].min_length
+				|| (commands[header->cmd].validate && !commands[header->cmd].validate(header, num_files))) {
+			if(!out)
+				backend_debug("Invalid choreography command %x at %u ignored\n",
+						(unsigned int)header->cmd, (unsigned int)header->start_ms);
+			continue;
+		}
+
+		if(header->cmd == CMD_END && ((struct choreography_end *)header)->end_of_scene == 0) {
+			*end_out = header;
 			break;
+		}
+
+		if(commands[header->cmd].handler == NULL)
+			continue;
+
+		if(out) {
+			out[count].start_ms = header->start_ms;
+			out[count].handler = commands[header->cmd].handler;
+			out[count].payload = header;
+		}
+		count++;
 	}
+
+	return count;
 }
 
-static inline bool end_of_demo()
+static inline void timeline_run_entry(int ms)
 {
-	return pos->cmd == CMD_END && ((struct choreography_end *)pos)->end_of_scene == 0;
+	timeline[timeline_pos].handler(ms, timeline[timeline_pos].payload);
 }
 
 static void create_new_state(unsigned ms)
 {
 	/* Create the state */
 
-	while(pos->start_ms <= ms && !end_of_demo()) {
-		create_state_item(ms, pos);
-		pos = next_header(pos);
+	while(timeline_pos < timeline_length && timeline[timeline_pos].start_ms <= ms) {
+		timeline_run_entry(ms);
+		timeline_pos++;
 	}
 }
 
+#ifdef BACKEND_SUPPORTS_PREFETCH
+/* Ask for the next few commands' slow work to be done in the background,
+ * predicting the sizes of the planes they'll draw into from any scene
+ * changes on the way. */
+static void prefetch_upcoming(void)
+{
+	int width[6], height[6];
+
+	if(timeline_pos == prefetch_scanned_pos)
+		return;
+	prefetch_scanned_pos = timeline_pos;
+
+	for(int i = 0; i < 6; i++) {
+		width[i] = backend_bitplane[i].width;
+		height[i] = backend_bitplane[i].height;
+	}
+
+	prefetch_begin_scan();
+
+	int jobs = 0;
+	int last = timeline_pos + PREFETCH_LOOKAHEAD_COMMANDS;
+	if(last > timeline_length)
+		last = timeline_length;
+
+	for(int i = timeline_pos; i < last && jobs < PREFETCH_LOOKAHEAD_JOBS; i++) {
+		struct choreography_header *header = timeline[i].payload;
+
+		switch(header->cmd) {
+			case CMD_SCENE: {
+				struct choreography_scene *scene = (struct choreography_scene *)header;
+				for(int plane = 0; plane < 6; plane++)
+					bitplane_style_size(scene->bitplane_style[plane], &width[plane], &height[plane]);
+				break;
+			}
+#ifdef BACKEND_SUPPORTS_ILBM
+			case CMD_ILBM: {
+				struct choreography_ilbm *ilbm = (struct choreography_ilbm *)header;
+				int x, y, w, h;
+
+				if(width[ilbm->plane]) {
+					ilbm_rect(ilbm, width[ilbm->plane], height[ilbm->plane], &x, &y, &w, &h);
+					prefetch_ilbm(ilbm, ilbm->file_idx, width[ilbm->plane], height[ilbm->plane], x, y, w, h, ilbm->plane);
+					jobs++;
+				}
+				break;
+			}
+#endif
+			case CMD_MBIT:
+				prefetch_mbit(header, ((struct choreography_mbit *)header)->file_idx);
+				jobs++;
+				break;
+			case CMD_LOADFONT:
+				if(width[0]) {
+					prefetch_font(((struct choreography_loadfont *)header)->file_idx, width[0], height[0]);
+					jobs++;
+				}
+				break;
+		}
+	}
+}
+#endif
+
 static void copy_planes_masked(int src_plane, uint8_t mask)
 {
 	struct Bitplane *src = &backend_bitplane[src_plane];
@@ -628,10 +1040,10 @@ static void run(int ms) {
 	if(state.fade_count != 0) {
 		if(ms > state.fade_end_ms) {
 			// we're done with this palette fade
-			backend_set_palette(state.fade_count, state.fade_to);
+			palette_set(state.fade_count, state.fade_to);
 			state.fade_count = 0;
 		} else {
-			graphics_lerp_palette(state.fade_count, state.fade_from, state.fade_to, ms - state.fade_start_ms, state.fade_end_ms - state.fade_start_ms);
+			palette_fade_step(&state.fade, ms - state.fade_start_ms);
 		}
 	}
 
@@ -644,10 +1056,10 @@ static void run(int ms) {
 	// TODO slow this down to once per anim frame? 
 	if(state.epilepsy) {
 		if(state.epilepsy_last_frame == false) {
-			backend_set_palette(0, NULL);
+			palette_set(0, NULL);
 		} else if (state.fade_count == 0) {
 			/* Don't reset the palette if we're doing a fade. */
-			backend_set_palette(32, state.fade_to);
+			palette_set(32, state.fade_to);
 		}
 		state.epilepsy_last_frame = !state.epilepsy_last_frame;
 	}
@@ -658,32 +1070,324 @@ static void run(int ms) {
 	}
 }
 
-static void skip_to_start_ms(unsigned ms) {
-	/* Advance to the requested position. */
-	pos = (struct choreography_header *)choreography;
+/* How much of a command replay_to_ms needs to run. */
+#define REPLAY_RUN 0
+#define REPLAY_SKIP 1 // replaced by a later command before the target
+#define REPLAY_PALETTE_ONLY 2 // an image cleared away before the target
+
+/* Decide what replaying timeline[i] must do, given the commands after it up
+ * to (not including) timeline[end]. Nothing is drawn on the way, so only an
+ * effect starting can see a plane or the font before the target does. */
+static int replay_action(int i, int end)
+{
+	struct choreography_header *header = timeline[i].payload;
+	uint8_t drawn = 0, cleared = 0; // plane masks
+
+	switch(header->cmd) {
+		case CMD_ANIM:
+		case CMD_LOADFONT:
+			break;
+		case CMD_ILBM:
+			drawn = (0x3f << ((struct choreography_ilbm *)header)->plane) & 0x3f;
+			break;
+		case CMD_MBIT:
+			drawn = 0x3f;
+			break;
+		default:
+			return REPLAY_RUN;
+	}
+
+	for(int j = i + 1; j < end; j++) {
+		struct choreography_header *later = timeline[j].payload;
+
+		if(later->cmd == header->cmd && !drawn)
+			return REPLAY_SKIP;
+
+		if(later->cmd == CMD_STARTEFFECT && header->cmd != CMD_ANIM)
+			return REPLAY_RUN;
+
+		if(later->cmd == CMD_SCENE && drawn)
+			return REPLAY_RUN; // the new planes may reuse its pool memory uncleared
+
+		if(later->cmd == CMD_CLEAR && drawn) {
+			uint32_t plane = ((struct choreography_clear *)later)->plane;
+
+			cleared |= plane == 0xff ? 0x3f : 1 << plane;
+			if((drawn & ~cleared) == 0)
+				return REPLAY_PALETTE_ONLY;
+		}
+	}
+
+	return REPLAY_RUN;
+}
+
+/* Run the commands up to 'ms' without drawing any frames, leaving out the
+ * slow work (decoding images, loading animations and fonts) whose results
+ * later commands replace before 'ms' is reached. */
+static void replay_to_ms(unsigned ms) {
 	/* Linear search to get to the exact point */
-	while(pos->start_ms < ms && pos->cmd != CMD_END) {
-		create_state_item(ms, pos);
-		pos = next_header(pos);
+	int end = timeline_pos;
+	while(timeline[end].start_ms < ms && timeline[end].payload->cmd != CMD_END)
+		end++;
+
+	for(; timeline_pos < end; timeline_pos++) {
+		struct choreography_header *header = timeline[timeline_pos].payload;
+
+		heap_frame_reset(); // each command replayed stands in for a frame
+
+		switch(replay_action(timeline_pos, end)) {
+			case REPLAY_RUN:
+				timeline_run_entry(ms);
+				break;
+			case REPLAY_PALETTE_ONLY:
+				if(header->cmd == CMD_ILBM)
+					cmd_ilbm_palette_only((struct choreography_ilbm *)header);
+				else
+					cmd_mbit_palette_only((struct choreography_mbit *)header);
+				break;
+		}
 	}
 }
 
-bool choreography_prepare_to_run(uint8_t *choreography_in, int ms)
+static void skip_to_start_ms(unsigned ms) {
+	/* Advance to the requested position. */
+	timeline_pos = 0;
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	prefetch_scanned_pos = -1;
+#endif
+	replay_to_ms(ms);
+}
+
+bool choreography_prepare_to_run(uint8_t *choreography_in, size_t size, int ms)
 {
-	choreography = choreography_in;
+	struct choreography_header *end;
+	int num_files = backend_wad_get_file_count();
+
+	base_heap_location = heap_get_location();
+
+	int length = timeline_compile(choreography_in, size, num_files, NULL, &end);
+	timeline = heap_alloc((length + 1) * sizeof(struct timeline_entry));
+	if(timeline == NULL) {
+		backend_debug("Couldn't allocate choreography timeline of %d commands", length);
+		return false;
+	}
+
+	timeline_length = timeline_compile(choreography_in, size, num_files, timeline, &end);
+	timeline[timeline_length].start_ms = end->start_ms;
+	timeline[timeline_length].handler = cmd_end;
+	timeline[timeline_length].payload = end;
 
 	skip_to_start_ms(ms);
 	//backend_wad_unload_file(choreography);
 	return true;
 }
 
+/* Stop whatever is currently running, ready to set up another position. */
+static void stop_current_state(void)
+{
+	if(state.effect_deinit)
+		state.effect_deinit();
+	state.effect_tick = state.effect_deinit = NULL;
+
+	if(state.animation_is_running)
+		anim_destroy(state.current_animation);
+}
+
+/* Start again from 'ms' in the same process. Only the choreography's own
+ * state is thrown away: loaded files and caches are kept. */
+bool choreography_restart(int ms)
+{
+	stop_current_state();
+	heap_set_location(base_heap_location);
+	memset(&state, 0, sizeof(state));
+	choreography_init();
+
+	size_t size;
+	uint8_t *choreography = backend_wad_load_choreography_for_scene_ms(ms, &size);
+
+	return choreography_prepare_to_run(choreography, size, ms);
+}
+
+// True once the end of the demo, rather than of a scene, has been reached.
+bool choreography_finished(int ms)
+{
+	return timeline_pos == timeline_length && (uint32_t)ms >= timeline[timeline_length].start_ms;
+}
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+/* Keyframes for seeking. Each one holds everything needed to carry on
+ * playing from its 'ms' without replaying the choreography before it. */
+struct snapshot {
+	int ms;
+	struct choreography_header *next_cmd; // the timeline may be recompiled, so don't keep an index
+	uint32_t palette[32];
+	struct choreography_state state;
+	void *scene_data;
+	void *backend_data;
+	void *heap_data; // everything above the timeline, such as effect data
+};
+
+static struct snapshot *snapshots[SNAPSHOT_COUNT];
+static int next_snapshot_slot;
+static bool snapshots_enabled; // they cost a copy of the planes and heap every SNAPSHOT_INTERVAL_MS
+
+/* Keep keyframes while playing, so that seeking back (or forward to somewhere
+ * already played) is quick. Without them seeking replays from the scene start. */
+void choreography_enable_snapshots(bool enabled)
+{
+	snapshots_enabled = enabled;
+
+	if(!enabled) {
+		for(int i = 0; i < SNAPSHOT_COUNT; i++) {
+			free(snapshots[i]);
+			snapshots[i] = NULL;
+		}
+	}
+}
+
+static void snapshot_take_if_due(int ms)
+{
+	for(int i = 0; i < SNAPSHOT_COUNT; i++) {
+		if(snapshots[i] && abs(snapshots[i]->ms - ms) < SNAPSHOT_INTERVAL_MS)
+			return;
+	}
+
+	size_t scene_size = align(scene_snapshot_size(), sizeof(uintptr_t));
+	size_t backend_size = align(backend_snapshot_size(), sizeof(uintptr_t));
+	size_t heap_size = heap_snapshot_size(base_heap_location + 1);
+
+	free(snapshots[next_snapshot_slot]);
+	struct snapshot *snap = snapshots[next_snapshot_slot] = malloc(sizeof(struct snapshot) + scene_size + backend_size + heap_size);
+	if(snap == NULL) {
+		backend_debug("snapshot: out of memory");
+		return;
+	}
+	next_snapshot_slot = (next_snapshot_slot + 1) % SNAPSHOT_COUNT;
+
+	snap->ms = ms;
+	snap->next_cmd = timeline[timeline_pos].payload;
+	palette_get(32, snap->palette);
+	snap->state = state;
+	snap->scene_data = (uint8_t *)(snap + 1);
+	snap->backend_data = (uint8_t *)snap->scene_data + scene_size;
+	snap->heap_data = (uint8_t *)snap->backend_data + backend_size;
+	scene_snapshot_save(snap->scene_data);
+	backend_snapshot_save(snap->backend_data);
+	heap_snapshot_save(base_heap_location + 1, snap->heap_data);
+}
+
+/* Timeline index of a command, or -1 if it isn't in the current timeline.
+ * Commands are in memory order, so this is a binary search. */
+static int timeline_find(struct choreography_header *cmd)
+{
+	if(timeline[timeline_length].payload == cmd)
+		return timeline_length;
+
+	int low = 0, high = timeline_length - 1;
+	while(low <= high) {
+		int mid = (low + high) / 2;
+
+		if(timeline[mid].payload == cmd)
+			return mid;
+		else if((uint8_t *)timeline[mid].payload < (uint8_t *)cmd)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	return -1;
+}
+
+static void apply_scene_options(struct choreography_scene_options *scene_options)
+{
+	struct choreography_scene_options null_scene_options;
+
+	if(scene_options == NULL) {
+		null_scene_options.zoom = 1;
+		null_scene_options.flags = 0;
+		scene_options = &null_scene_options;
+	}
+
+	cmd_scene_options(0, scene_options);
+}
+
+static void snapshot_restore(struct snapshot *snap)
+{
+	stop_current_state();
+
+	if(snap->state.loadfont_cmd && snap->state.loadfont_cmd != state.loadfont_cmd)
+		cmd_loadfont(snap->state.loadfont_cmd->header.start_ms, snap->state.loadfont_cmd);
+
+	/* Planes first, as the effect may set itself up using them. */
+	backend_snapshot_restore(snap->backend_data);
+	apply_scene_options(snap->state.scene_options_cmd);
+
+	state = snap->state;
+	state.effect_tick = state.effect_deinit = NULL;
+
+	if(state.effect_cmd) {
+		heap_set_location(state.effect_heap_location);
+		cmd_starteffect(state.effect_cmd->header.start_ms, state.effect_cmd);
+
+		/* ... then put back anything its initialisation changed. */
+		backend_snapshot_restore(snap->backend_data);
+	}
+	scene_snapshot_restore(snap->scene_data);
+	heap_snapshot_restore(snap->heap_data);
+
+	anim_set_xor(state.current_animation_info.xor);
+	if(state.animation_is_running) {
+		state.current_animation = anim_load(anim_file_idx(state.current_animation_info.data_file),
+				anim_file_idx(state.current_animation_info.prev_data_file));
+	}
+
+	palette_set(32, snap->palette);
+	timeline_pos = timeline_find(snap->next_cmd);
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	prefetch_scanned_pos = -1;
+#endif
+}
+
+/* Jump to 'ms': restore the latest snapshot before it and replay the
+ * commands in between, or replay from the start of the scene if there isn't one.
+ * Either way replay_to_ms leaves out work which is replaced before 'ms'. */
+bool choreography_seek(int ms)
+{
+	struct snapshot *best = NULL;
+
+	for(int i = 0; i < SNAPSHOT_COUNT; i++) {
+		struct snapshot *snap = snapshots[i];
+		if(snap && snap->ms <= ms && (best == NULL || snap->ms > best->ms)
+				&& timeline_find(snap->next_cmd) >= 0 && heap_snapshot_matches(snap->heap_data))
+			best = snap;
+	}
+
+	if(best) {
+		snapshot_restore(best);
+		replay_to_ms(ms);
+		return true;
+	}
+
+	return choreography_restart(ms);
+}
+#endif
+
 // Return false if the next frame is end of scene or end of demo, true otherwise.
 bool choreography_do_frame(int ms)
 {
 	create_new_state(ms);
 	run(ms);
 
-	return pos->cmd == CMD_END;
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	prefetch_upcoming();
+#endif
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+	if(snapshots_enabled)
+		snapshot_take_if_due(ms);
+#endif
+
+	return timeline[timeline_pos].payload->cmd == CMD_END;
 }
 
 // Find a scene offset using the choreography scene index.
@@ -23,8 +23,17 @@ struct choreography_scene_index {
 bool choreography_init();
 void choreography_run_demo(int ms);
 
-bool choreography_prepare_to_run(uint8_t *choreography_in, int ms);
+#include <stddef.h>
+
+bool choreography_prepare_to_run(uint8_t *choreography_in, size_t size, int ms);
 bool choreography_do_frame(int ms);
+bool choreography_restart(int ms);
+bool choreography_finished(int ms);
 uint32_t choreography_find_offset_for_scene(uint8_t *choreography, unsigned ms, uint32_t *next_scene_offset);
 uint32_t choreography_find_ms_for_scene_name(uint8_t *choreography, char *name);
 
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+void choreography_enable_snapshots(bool enabled);
+bool choreography_seek(int ms);
+#endif
+
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include "endian_compat.h"
 #include "graphics.h"
+#include "blitter.h"
 #include "backend.h"
 #include "minmax.h"
 #include "heap.h"
@@ -47,46 +48,46 @@ int graphics_shutdown() {
 	return 0;
 }
 
-static inline uint32_t lerp_byte(int idx, uint32_t byte_from, uint32_t byte_to, int current_step, int total_steps)
-{
-	if(current_step == 0) 
-		return byte_from;
+/* Heart of everything! */
 
-	byte_from >>= (idx * 8);
-	byte_from &= 0xff;
+/* Polygons with up to MAX_LINES edges use the static tables. Larger ones use
+ * tables grown to fit the largest polygon seen so far. */
+static struct poly_elem line_info_small[MAX_LINES];
+static struct poly_elem *active_list_small[MAX_LINES];
+static struct poly_elem *line_info_large;
+static struct poly_elem **active_list_large;
+static int large_capacity = 0;
 
-	byte_to >>= (idx * 8);
-	byte_to &= 0xff;
+static struct poly_elem **active_list;
+static int next_active_list = 0;
 
-	int lerped = ((((int)byte_to) - ((int)byte_from)) * current_step) / total_steps;
+/* Ensure polygons with this many edges can be drawn. Call when loading data so
+ * that drawing doesn't need to allocate. */
+bool graphics_reserve_polygon_edges(int num_edges)
+{
+	if(num_edges <= MAX_LINES || num_edges <= large_capacity)
+		return true;
 
-	return min(0xff, byte_from + lerped);
-}
+	int capacity = max(num_edges, large_capacity * 2);
 
-void graphics_lerp_palette(size_t num_elements, uint32_t *from, uint32_t *to, int current_step, int total_steps) {
-	if(current_step < 0 || current_step > total_steps || num_elements > 32)
-		return;
+	struct poly_elem *new_line_info = backend_resize_reserved_memory(line_info_large, large_capacity * sizeof(struct poly_elem), capacity * sizeof(struct poly_elem));
+	if(new_line_info == NULL) {
+		backend_debug("graphics_reserve_polygon_edges: couldn't alloc %d", capacity);
+		return false;
+	}
+	line_info_large = new_line_info;
 
-	for(unsigned i = 0; i < num_elements; i++) {
-		backend_set_palette_element(i, (lerp_byte(3, from[i], to[i], current_step, total_steps) << 24)
-			| (lerp_byte(2, from[i], to[i], current_step, total_steps) << 16)
-			| (lerp_byte(1, from[i], to[i], current_step, total_steps) << 8)
-			| (lerp_byte(0, from[i], to[i], current_step, total_steps)));
+	struct poly_elem **new_active_list = backend_resize_reserved_memory(active_list_large, large_capacity * sizeof(struct poly_elem *), capacity * sizeof(struct poly_elem *));
+	if(new_active_list == NULL) {
+		backend_debug("graphics_reserve_polygon_edges: couldn't alloc %d", capacity);
+		return false;
 	}
-}
+	active_list_large = new_active_list;
+	large_capacity = capacity;
 
-static inline void planar_putpixel(struct Bitplane *plane, int x, int y)
-{
-	if(x >= 0 && x < plane->width && y >= 0 && y <= plane->height)
-		plane->data[(y * plane->stride) + x / 8] |= (1 << (7 - (x % 8)));
+	return true;
 }
 
-/* Heart of everything! */
-
-static struct poly_elem line_info[MAX_LINES];
-static struct poly_elem *active_list[MAX_LINES];
-static int next_active_list = 0;
-
 static inline void add_active(struct poly_elem *new_elem)
 {
 	active_list[next_active_list ++] = new_elem;
@@ -110,70 +111,73 @@ static int active_list_comparator(const void *lhs, const void *rhs) {
 	return 0;
 }
 
-static void planar_line_thick(struct Bitplane *bitplane, int x0, int y0, int x1, int y1, int thickness)
+/* x co-ordinate of the line (x0, y0)-(x1, y1) at half-row y2 / 2, rounded to
+ * nearest and clamped to the segment. Requires y0 < y1. */
+static inline int line_x_at_half(int x0, int y0, int x1, int y1, int y2)
 {
-	/* Modified from rosettacode's standard Bresenham algorithm. Could be
-	 * improved -- lots of overdraw */
-	int dx = abs(x1 - x0);
-	int sx = x0 < x1 ? 1 : -1;
-	int dy = abs(y1 - y0);
-	int sy = y0<y1 ? 1 : -1; 
-	int err = (dx > dy ? dx : -dy) / 2;
-	int e2;
-
-	int half_thickness = thickness / 2;
-
-	for(;;){
-		for(int ythick = -half_thickness; ythick < half_thickness; ythick++){
-			for(int xthick= -half_thickness; xthick<= half_thickness; xthick++) {
-				planar_putpixel(bitplane, x0 + xthick, y0 + ythick);
-			}
-		}
-		if (x0 == x1 && y0 == y1)
-			break;
-
-		e2 = err;
-
-		if (e2 >-dx) {
-			err -= dy; x0 += sx;
-		}
+	int num = (x1 - x0) * (y2 - 2 * y0);
+	int den = 2 * (y1 - y0);
+	int x = x0 + (num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den));
 
-		if (e2 < dy) {
-			err += dx; y0 += sy;
-		}
-	}
+	return x0 < x1 ? min(max(x, x0), x1) : min(max(x, x1), x0);
 }
 
-void graphics_draw_scaled_polygon_to_bitmap(int num_vertices, uint8_t *data, float scalex, float scaley, int xofs, int yofs, struct Bitplane *bitplane)
+/* Sweep a square brush of side 'thickness' along a line, emitting one span per row.
+ * The brush covers x - t/2 .. x + t/2 and y - t/2 .. y + t/2 - 1 for even t, and
+ * t rows for odd t, so thickness 1 is a one-pixel line. The brush at each end forms
+ * a square cap, so consecutive segments sharing a vertex are joined without gaps. */
+void planar_thick_line(struct Bitplane *plane, int x0, int y0, int x1, int y1, int thickness)
 {
-	int y0, x0, y1, x1;
+	int half = thickness / 2;
+	int below = half - 1 + (thickness & 1); // brush rows below the line point
 
-	y0 = data[0];
-	x0 = data[1];
-	x0 = x0 * scalex + xofs;
-	y0 = y0 * scaley + yofs;
+	if(below < 0)
+		below = 0;
 
-	for(int i=2; i < (num_vertices * 2); i+= 2) {
+	if(y0 > y1) {
+		int tmp;
+		tmp = y0; y0 = y1; y1 = tmp;
+		tmp = x0; x0 = x1; x1 = tmp;
+	}
 
-		y1 = data[i];
-		x1 = data[i+1];
+	int start_y = max(y0 - half, 0);
+	int end_y = min(y1 + below, plane->height - 1);
 
-		x1 = x1 * scalex + xofs;
-		y1 = y1 * scaley + yofs;
+	for(int y = start_y; y <= end_y; y++) {
+		// Line points whose brush touches this row, clamped to the segment.
+		int lo = max(y - below, y0);
+		int hi = min(y + half, y1);
+		int xa, xb;
+
+		if(y0 == y1) {
+			xa = x0;
+			xb = x1;
+		} else {
+			// Include the whole run of x for each end row, not just its centre.
+			xa = line_x_at_half(x0, y0, x1, y1, 2 * lo - 1);
+			xb = line_x_at_half(x0, y0, x1, y1, 2 * hi + 1);
+		}
 
-		planar_line_thick(bitplane, x0, y0, x1, y1, outline_width);
+		if(xa > xb) {
+			int tmp = xa; xa = xb; xb = tmp;
+		}
 
-		x0 = x1;
-		y0 = y1;
+		planar_line_horizontal(plane, y, xa - half, xb + half + 1, false, 0xffff);
 	}
+}
 
-	/* Close the shape */
-	y0 = data[0];
-	x0 = data[1];
-	x0 = x0 * scalex + xofs;
-	y0 = y0 * scaley + yofs;
+void graphics_draw_scaled_polygon_to_bitmap(int num_vertices, uint8_t *data, float scalex, float scaley, int xofs, int yofs, struct Bitplane *bitplane)
+{
+	for(int i = 0; i < num_vertices; i++) {
+		int next = (i + 1) % num_vertices; // the last edge closes the shape
+
+		int y0 = data[i * 2] * scaley + yofs;
+		int x0 = data[i * 2 + 1] * scalex + xofs;
+		int y1 = data[next * 2] * scaley + yofs;
+		int x1 = data[next * 2 + 1] * scalex + xofs;
 
-	planar_line_thick(bitplane, x0, y0, x1, y1, outline_width);
+		planar_thick_line(bitplane, x0, y0, x1, y1, outline_width);
+	}
 }
 
 
@@ -190,8 +194,21 @@ void graphics_draw_filled_scaled_polygon_to_bitmap(int num_vertices, uint8_t *da
 	// is an index into the line_info table.
 	int next_line_info = 0;
 	int i;
+	struct poly_elem *line_info = line_info_small;
+
+	active_list = active_list_small;
+
+	if(num_vertices > MAX_LINES) {
+		if(!graphics_reserve_polygon_edges(num_vertices))
+			return;
+
+		line_info = line_info_large;
+		active_list = active_list_large;
+	}
 	int global_ymin = window_height;
 	int global_ymax = 0;
+	int global_xmin = window_width;
+	int global_xmax = 0;
 
 	/* Clear edge table */
 	memset(edge_table, 0, window_height * sizeof(struct poly_elem *));
@@ -256,6 +273,9 @@ void graphics_draw_filled_scaled_polygon_to_bitmap(int num_vertices, uint8_t *da
 		if(y0 < global_ymin)
 			global_ymin = y0; // highest point of the polygon.
 
+		global_xmin = min(global_xmin, min(x0, x1));
+		global_xmax = max(global_xmax, max(x0, x1));
+
 		if(y1 > global_ymax) 
 			global_ymax = y1;
 
@@ -271,7 +291,7 @@ void graphics_draw_filled_scaled_polygon_to_bitmap(int num_vertices, uint8_t *da
 		edge_table[y0] = elem;
 	}
 
-	assert(next_line_info < MAX_LINES);
+	planar_extent_add(bitplane, global_xmin, global_ymin, global_xmax, global_ymax);
 
 	// Active edge table: subset of the edge table which is currently being drawn.
 	next_active_list = 0; // reset the active list
@@ -381,6 +401,8 @@ void planar_line_horizontal(struct Bitplane *plane, int y, int start_x, int end_
 	if(start_x > end_x)
 		return;
 
+	planar_extent_add(plane, start_x, y, end_x, y);
+
 	uint32_t *data = (uint32_t *)(plane->data + y * plane->stride) + (start_x / 32);
 	uint32_t *end_data = (uint32_t *)(plane->data + y * plane->stride) + (end_x / 32);
 
@@ -411,6 +433,8 @@ void planar_line_vertical(struct Bitplane *plane, int x, int start_y, int end_y,
 	if(start_y > end_y)
 		return;
 
+	planar_extent_add(plane, x, start_y, x, end_y);
+
 	uint8_t *data = plane->data;
 	uint8_t pen = 1 << (7 - (x % 8));
 	
@@ -435,73 +459,122 @@ void planar_line_vertical(struct Bitplane *plane, int x, int start_y, int end_y,
 	}
 }
 
-void planar_draw_thick_circle(struct Bitplane *bitplane, int xc, int yc, int radius, int thickness) {
-	if(radius <= 0)
-		return;
+/* Solid span on row y covering start_x up to but not including end_x (as
+ * planar_line_horizontal does). No clipping: the caller guarantees
+ * 0 <= y < height and 0 <= start_x < end_x <= width. */
+static inline void planar_span_unchecked(struct Bitplane *plane, int y, int start_x, int end_x)
+{
+	uint32_t *row = (uint32_t *)(plane->data + y * plane->stride);
+	uint32_t *data = row + (start_x / 32);
+	uint32_t *last = row + ((end_x - 1) / 32); // never touches the word after the span
+	uint32_t start = htobe32(0xffffffff >> (start_x % 32));
+	uint32_t end = htobe32(0xffffffff << ((32 - (end_x % 32)) % 32));
 
-	int xouter = radius;
-    int xinner = radius - thickness;;
-    int y = 0;
-    int errouter = 1 - xouter;
-    int errinner = 1 - xinner;
-
-	while(xouter >= y) {
-		planar_line_horizontal(bitplane, yc + y, xc + xinner, xc + xouter, false, 0xffff);
-		planar_line_vertical(bitplane, xc + y,  yc + xinner, yc + xouter, false, 0xffff);
-		planar_line_horizontal(bitplane, yc + y, xc - xouter, xc - xinner, false, 0xffff);
-		planar_line_vertical(bitplane, xc - y,  yc + xinner, yc + xouter, false, 0xffff);
-		planar_line_horizontal(bitplane, yc - y, xc - xouter, xc - xinner, false, 0xffff);
-		planar_line_vertical(bitplane, xc - y,  yc - xouter, yc - xinner, false, 0xffff);
-		planar_line_horizontal(bitplane, yc - y, xc + xinner, xc + xouter, false, 0xffff);
-		planar_line_vertical(bitplane, xc + y,  yc - xouter, yc - xinner, false, 0xffff);
-
-		y++;
-
-		if (errouter < 0) {
-			errouter += 2 * y + 1;
-		} else {
-			xouter --;
-			errouter += 2 * (y - xouter + 1);
-		}
+	if(data == last) {
+		*data |= (start & end);
+	} else {
+		*data++ |= start;
 
-		if (y > radius) {
-			xinner = y;
-		} else {
-			if (errinner < 0) {
-				errinner += 2 * y + 1;
-			} else {
-				xinner --;
-				errinner += 2 * (y - xinner + 1);
+		while(data < last)
+			*data++ = 0xffffffff;
+
+		*data |= end;
+	}
+}
+
+/* Span of an annulus row, clamped to the plane if 'clip' is set. */
+static inline void annulus_span(struct Bitplane *plane, bool clip, int y, int start_x, int end_x)
+{
+	if(clip) {
+		start_x = max(start_x, 0);
+		end_x = min(end_x, plane->width);
+
+		if(start_x >= end_x)
+			return;
+	}
+
+	planar_span_unchecked(plane, y, start_x, end_x);
+}
+
+/* Both halves of annulus row yc +/- dy: pixels with xi < |x - xc| <= xo, or the
+ * whole of -xo..xo if there is no hole on this row (xi < 0). Unless 'clip' is set,
+ * the caller guarantees the whole annulus is on the plane. */
+static inline void annulus_rows(struct Bitplane *plane, bool clip, int xc, int yc, int dy, int xo, int xi)
+{
+	for(int y = yc - dy; y <= yc + dy; y += 2 * dy) {
+		if(!clip || (y >= 0 && y < plane->height)) {
+			if(xi < 0) {
+				annulus_span(plane, clip, y, xc - xo, xc + xo + 1);
+			} else if(xi < xo) {
+				annulus_span(plane, clip, y, xc - xo, xc - xi);
+				annulus_span(plane, clip, y, xc + xi + 1, xc + xo + 1);
 			}
 		}
+
+		if(dy == 0)
+			break;
 	}
 }
 
-void planar_circle(struct Bitplane *plane, int x0, int y0, int radius)
+/* Half-width of row dy of a filled midpoint circle of radius r, or -1 if the
+ * row is outside it. Walks x down from its value for the previous row. */
+static inline int disc_half_width(int r, int dy, int x)
 {
-	int x = radius;
-	int y = 0;
-	int err = 0;
-
-	while(x >= y) {
-		planar_putpixel(plane, x0 + x, y0 + y);
-		planar_putpixel(plane, x0 + y, y0 + x);
-		planar_putpixel(plane, x0 - y, y0 + x);
-		planar_putpixel(plane, x0 - x, y0 + y);
-		planar_putpixel(plane, x0 - x, y0 - y);
-		planar_putpixel(plane, x0 - y, y0 - x);
-		planar_putpixel(plane, x0 + y, y0 - x);
-		planar_putpixel(plane, x0 + x, y0 - y);
-
-		y += 1;
-		err += 1 + 2*y;
-		if (2 * (err - x) + 1 > 0) {
-			x -= 1;
-			err += 1 - 2 * x;
-		}
+	int limit = r * r + r;
+
+	if(r < 0 || dy > r)
+		return -1;
+
+	while(x >= 0 && x * x + dy * dy > limit)
+		x--;
+
+	return x;
+}
+
+/* Filled ring between two midpoint circles, including the outlines of both. Row
+ * dy covers xi < |x - xc| <= xo, where xo is the half-width of the outer disc.
+ * The hole is the inner disc less its outline: the inner disc's half-width on
+ * the next row out, but at least one pixel in from this row's. Emits at most
+ * two spans per row. */
+void planar_annulus(struct Bitplane *plane, int xc, int yc, int outer, int inner)
+{
+	if(outer < 0)
+		return;
+
+	bool clip = xc - outer < 0 || xc + outer >= plane->width
+		|| yc - outer < 0 || yc + outer >= plane->height;
+
+	planar_extent_add(plane, xc - outer, yc - outer, xc + outer, yc + outer);
+
+	int xo = outer;
+	int xi = disc_half_width(inner, 0, inner);
+
+	for(int dy = 0; dy <= outer; dy++) {
+		int xi_next = disc_half_width(inner, dy + 1, xi);
+		int hole = min(xi_next, xi - 1);
+
+		xo = disc_half_width(outer, dy, xo);
+		xi = xi_next;
+
+		if(clip && (yc + dy < 0 || yc - dy >= plane->height))
+			continue;
+
+		annulus_rows(plane, clip, xc, yc, dy, xo, hole);
 	}
 }
 
+void planar_draw_thick_circle(struct Bitplane *bitplane, int xc, int yc, int radius, int thickness) {
+	if(radius <= 0)
+		return;
+
+	planar_annulus(bitplane, xc, yc, radius, radius - thickness);
+}
+
+void planar_circle(struct Bitplane *plane, int x0, int y0, int radius)
+{
+	planar_annulus(plane, x0, y0, radius, radius);
+}
+
 void planar_filled_rect(struct Bitplane *plane, int sx, int sy, int ex, int ey)
 {
 	sy = min(max(sy, 0), plane->height - 1);
@@ -512,6 +585,8 @@ void planar_filled_rect(struct Bitplane *plane, int sx, int sy, int ex, int ey)
 	if(sx > ex || sy > ey)
 		return;
 
+	planar_extent_add(plane, sx, sy, ex, ey);
+
 	uint32_t pattern32 = 0xffffffff; // (((uint32_t)pattern) << 16) | pattern;
 
 	for(int y = sy; y <= ey; y++) {
@@ -527,123 +602,153 @@ void planar_clear(struct Bitplane *plane)
 	if(plane->data_start) {
 		memset(plane->data_start, 0, plane->stride * plane->height);
 	}
-}
 
-static inline uint8_t update_masked_word(uint8_t orig, uint8_t value, int end_bit)
-{
-	uint8_t copied_mask = 0xff << (8 - (end_bit % 8));
-	value &= copied_mask;
-	uint8_t src_mask = 0xff >> (end_bit % 8);
-	value |= (orig & src_mask);
-	return value;
+	planar_extent_empty(plane);
 }
 
-void graphics_bitplane_blit_line(uint8_t *fromdata, uint8_t *todata, int sx, int w, int dx)
+/* Clear the rectangle (sx, sy)-(ex, ey) inclusive. The drawn extent is left
+ * alone, so stays an over-estimate. */
+void planar_clear_rect(struct Bitplane *plane, int sx, int sy, int ex, int ey)
 {
-	if(w <= 0)
+	sy = max(sy, 0);
+	ey = min(ey, plane->height - 1);
+	sx = max(sx, 0);
+	ex = min(ex, plane->width - 1);
+
+	if(sx > ex || sy > ey)
 		return;
 
-	int src_offset = (sx / 8);
-	int dst_offset = (dx / 8);
+	int start_byte = sx / 8;
+	int end_byte = ex / 8;
+	uint8_t start_mask = 0xff >> (sx % 8); // the bits to clear
+	uint8_t end_mask = 0xff << (7 - (ex % 8));
 
-	uint8_t *src = fromdata + src_offset;
-	uint8_t *dst = todata   + dst_offset;
-	uint8_t *end_word = todata + ((dx + w) / 8);
-	int end_bit = dx + w;
+	if(start_byte == end_byte)
+		start_mask &= end_mask;
 
-	if(((dx + w) % 8) == 0) {
-		/* We want end_word to point to the final usable word, not to the word after. */
-		end_word--;
+	uint8_t *row = plane->data + (sy * plane->stride);
+	for(int y = sy; y <= ey; y++, row += plane->stride) {
+		row[start_byte] &= ~start_mask;
+		if(end_byte > start_byte) {
+			memset(row + start_byte + 1, 0, end_byte - start_byte - 1);
+			row[end_byte] &= ~end_mask;
+		}
 	}
+}
 
-	uint8_t src_word = *src++;
-	uint8_t dst_word;
+/* Clear only what has been drawn since the last clear. Planes which are
+ * scrolled (data != data_start) are cleared entirely. */
+void planar_clear_drawn(struct Bitplane *plane)
+{
+	struct BitplaneExtent *drawn = &plane->drawn;
 
-	// Mask off the bits below dx in the initial word
-	if(!(dx % 8)) {
-		dst_word = 0;
-	} else {
-		dst_word = *dst & (0xff << (8 - (dx % 8)));
-	}
+	if(plane->data_start == NULL || drawn->x1 < drawn->x0)
+		return;
 
-	while(dx < end_bit) {
-		int src_avail = 8 - (sx % 8);
-		int dst_avail = 8 - (dx % 8);
+	if(plane->data != plane->data_start) {
+		planar_clear(plane);
+		return;
+	}
 
-		uint8_t bits;
+	int start_byte = drawn->x0 / 8;
+	int num_bytes = (drawn->x1 / 8) - start_byte + 1;
+	int num_rows = drawn->y1 - drawn->y0 + 1;
+	uint8_t *row = plane->data + (drawn->y0 * plane->stride);
 
-		if(src_avail < 8) {
-			bits = src_word & ((1 << src_avail) - 1); // mask off bits above src_avail..
-		} else {
-			bits = src_word;
+	if(num_bytes * 2 > plane->stride) {
+		/* Mostly-full rows: one contiguous clear is cheaper */
+		memset(row, 0, num_rows * plane->stride);
+	} else {
+		for(; num_rows; num_rows--) {
+			memset(row + start_byte, 0, num_bytes);
+			row += plane->stride;
 		}
+	}
 
-		if(src_avail > dst_avail) {
-			// More src bits than dst bits: we will be right shifting to move to dst.
+	planar_extent_empty(plane);
+}
 
-			// sx = 2, dx = 5
-			// src_avail = 30, dst_avail = 27
-			// dst |= bits >> 3
-			dst_word |= bits >> ( (dx % 8) - (sx % 8) );
+/* Make 'to' a copy of 'from', touching only what either has drawn. The
+ * planes must be the same size and not scrolled. */
+void planar_copy_drawn(struct Bitplane *from, struct Bitplane *to)
+{
+	planar_clear_drawn(to);
 
-			// we wrote dst_avail bits
-			sx += dst_avail;
-			dx += dst_avail;
-		} else {
-			// More dst bits than src bits; we will be left shifting to move to dst.
-			// sx = 5, dx = 2
-			// src_avail = 27, dst_avail = 30
-			// dst |= bits << 3;
-			dst_word |= bits << ( (sx % 8) - (dx % 8) );
-
-			// we wrote src_avail bits
-			sx += src_avail;
-			dx += src_avail;
-		}
+	struct BitplaneExtent *drawn = &from->drawn;
+	if(drawn->x1 < drawn->x0)
+		return;
 
-		if(!(sx % 8)) {
-			src_word = *src++;
-		}
-		if(!(dx % 8)) {
-			if(dx > end_bit) {
-				/* Reload the parts of the final word which we shouldn't have
-				 * touched.  NB end_bit % 8 will always be > 0 here -- only
-				 * time it can't be is if we had a width of 0, which is
-				 * special-cased at the start of the function. */
-				dst_word = update_masked_word(*dst, dst_word, end_bit);
-			}
-			*dst++ = dst_word;
-			dst_word = 0;
-		}
-	}
-	if(dst <= end_word) {
-		// dx advanced past length, but we didn't write the final word out.
-		*dst = update_masked_word(*dst, dst_word, end_bit);
+	int start_byte = drawn->x0 / 8;
+	int num_bytes = (drawn->x1 / 8) - start_byte + 1;
+	size_t offset = (drawn->y0 * from->stride) + start_byte;
+
+	for(int y = drawn->y0; y <= drawn->y1; y++) {
+		memcpy(to->data + offset, from->data + offset, num_bytes);
+		offset += from->stride;
 	}
+
+	to->drawn = from->drawn;
 }
 
-void graphics_bitplane_blit(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy)
+/* Blits go backwards when the destination follows the source in the same plane. */
+static bool blit_overlaps_forward(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int dx, int dy)
+{
+	return from->data == to->data && (dy > sy || (dy == sy && dx > sx));
+}
+
+void graphics_bitplane_blit_op(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy, uint8_t minterm)
 {
-	int src_offset = from->stride * sy;
-	int dst_offset = to->stride * dy;
+	struct blitter_op op;
 
-	uint8_t *src = from->data + src_offset;
-	uint8_t *dst = to->data   + dst_offset;
+	// B isn't wired up here, so the minterm mustn't depend on it
+	assert(((minterm >> 2) & 0x33) == (minterm & 0x33));
 
-	for( ; h; h--) {
-		graphics_bitplane_blit_line(src, dst, sx, w, dx);
+	blitter_op_init(&op, to, dx, dy, w, h, minterm);
+	blitter_set_channel(&op.a, from, sx, sy);
+	blitter_set_channel(&op.c, to, dx, dy);
+	op.descending = blit_overlaps_forward(from, to, sx, sy, dx, dy);
+	blitter_run(&op);
+}
+
+void graphics_bitplane_blit(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy)
+{
+	graphics_bitplane_blit_op(from, to, sx, sy, w, h, dx, dy, BLIT_MINTERM_A);
+}
 
-		src += from->stride;
-		dst += to->stride;
+void graphics_blit_op(struct Bitplane from[], struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy, uint8_t minterm)
+{
+	/* blit all planes in 'mask' */
+	for(int plane_idx = 0; plane_idx < 6; plane_idx++) {
+		if((mask & (1 << plane_idx)) != 0) {
+			graphics_bitplane_blit_op(&from[plane_idx], &to[plane_idx], sx, sy, w, h, dx, dy, minterm);
+		}
 	}
 }
 
 void graphics_blit(struct Bitplane from[], struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy)
 {
-	/* copy all planes in 'mask' */
+	graphics_blit_op(from, to, mask, sx, sy, w, h, dx, dy, BLIT_MINTERM_A);
+}
+
+/* Cookie-cut: the source replaces the destination only where 'cookie', which
+ * lines up with the source, is set. */
+void graphics_bitplane_blit_masked(struct Bitplane *from, struct Bitplane *cookie, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy)
+{
+	struct blitter_op op;
+
+	blitter_op_init(&op, to, dx, dy, w, h, BLIT_MINTERM_COOKIE);
+	blitter_set_channel(&op.a, cookie, sx, sy);
+	blitter_set_channel(&op.b, from, sx, sy);
+	blitter_set_channel(&op.c, to, dx, dy);
+	op.descending = blit_overlaps_forward(from, to, sx, sy, dx, dy);
+	blitter_run(&op);
+}
+
+void graphics_blit_masked(struct Bitplane from[], struct Bitplane *cookie, struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy)
+{
 	for(int plane_idx = 0; plane_idx < 6; plane_idx++) {
 		if((mask & (1 << plane_idx)) != 0) {
-			graphics_bitplane_blit(&from[plane_idx], &to[plane_idx], sx, sy, w, h, dx, dy);
+			graphics_bitplane_blit_masked(&from[plane_idx], cookie, &to[plane_idx], sx, sy, w, h, dx, dy);
 		}
 	}
 }
@@ -651,10 +756,17 @@ void graphics_blit(struct Bitplane from[], struct Bitplane to[], int mask, int s
 /* Fast copy of an entire bitplane */
 void graphics_copy_plane(struct Bitplane *from, struct Bitplane *to)
 {
-	if(from->width == to->width && from->height == to->height) {
-		size_t amt = (from->width * from->height / 8);
-		memcpy(to->data_start, from->data_start, amt);
+	if(from->width != to->width || from->height != to->height)
+		return;
+
+	if(from->stride == to->stride) {
+		memcpy(to->data_start, from->data_start, from->stride * from->height);
+	} else {
+		// strides can differ when either plane is padded
+		for(int y = 0; y < from->height; y++)
+			memcpy(to->data_start + (y * to->stride), from->data_start + (y * from->stride), from->width / 8);
 	}
+	to->drawn = from->drawn;
 }
 
 
@@ -3,29 +3,76 @@
 #include <stdbool.h>
 #include "backend.h"
 
-// Maximum number of lines in a polygon.
+// Polygons with more lines than this use dynamically-sized tables.
 #define MAX_LINES 128
 
 // administration
 int graphics_init();
 int graphics_shutdown();
 
-// the palette
-void graphics_lerp_palette(size_t num_elements, uint32_t *from, uint32_t *to, int current_step, int total_steps);
-
 // shapes
+bool graphics_reserve_polygon_edges(int num_edges);
 void graphics_draw_filled_scaled_polygon_to_bitmap(int num_vertices, uint8_t *data, float scalex, float scaley, int xofs, int yofs, struct Bitplane *bitplane, bool xorenabled, bool distort, bool flip_horizontal, bool flip_vertical);
 void graphics_draw_scaled_polygon_to_bitmap(int num_vertices, uint8_t *data, float scalex, float scaley, int xofs, int yofs, struct Bitplane *bitplane);
+void planar_thick_line(struct Bitplane *plane, int x0, int y0, int x1, int y1, int thickness);
 void planar_draw_thick_circle(struct Bitplane *bitplane, int xc, int yc, int radius, int thickness);
 void planar_circle(struct Bitplane *plane, int x0, int y0, int radius);
+void planar_annulus(struct Bitplane *plane, int xc, int yc, int outer, int inner);
 void planar_filled_rect(struct Bitplane *plane, int sx, int sy, int ex, int ey);
 
+// drawn extents
+static inline void planar_extent_empty(struct Bitplane *plane)
+{
+	plane->drawn.x0 = plane->drawn.y0 = 0;
+	plane->drawn.x1 = plane->drawn.y1 = -1;
+}
+
+static inline void planar_extent_full(struct Bitplane *plane)
+{
+	plane->drawn.x0 = plane->drawn.y0 = 0;
+	plane->drawn.x1 = plane->width - 1;
+	plane->drawn.y1 = plane->height - 1;
+}
+
+// Grow the extent to include the rectangle (sx, sy)-(ex, ey), clipped to the plane.
+static inline void planar_extent_add(struct Bitplane *plane, int sx, int sy, int ex, int ey)
+{
+	struct BitplaneExtent *drawn = &plane->drawn;
+
+	sx = sx < 0 ? 0 : sx;
+	sy = sy < 0 ? 0 : sy;
+	ex = ex >= plane->width ? plane->width - 1 : ex;
+	ey = ey >= plane->height ? plane->height - 1 : ey;
+
+	if(sx > ex || sy > ey)
+		return;
+
+	if(drawn->x1 < drawn->x0) {
+		drawn->x0 = sx; drawn->y0 = sy;
+		drawn->x1 = ex; drawn->y1 = ey;
+	} else {
+		if(sx < drawn->x0) drawn->x0 = sx;
+		if(sy < drawn->y0) drawn->y0 = sy;
+		if(ex > drawn->x1) drawn->x1 = ex;
+		if(ey > drawn->y1) drawn->y1 = ey;
+	}
+}
+
 // planar stuff
 void planar_line_vertical(struct Bitplane *plane, int x, int start_y, int end_y, bool xorenabled, uint16_t pattern);
 void planar_line_horizontal(struct Bitplane *plane, int y, int start_x, int end_x, bool xorenabled, uint16_t pattern);
 void planar_clear(struct Bitplane *plane);
+void planar_clear_rect(struct Bitplane *plane, int sx, int sy, int ex, int ey);
+void planar_clear_drawn(struct Bitplane *plane);
+void planar_copy_drawn(struct Bitplane *from, struct Bitplane *to);
 void graphics_bitplane_blit(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy);
+void graphics_bitplane_blit_op(struct Bitplane *from, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy, uint8_t minterm);
 void graphics_blit(struct Bitplane from[], struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy);
+// minterm is a blitter.h BLIT_MINTERM_* value using only A (the source) and C (the destination)
+void graphics_blit_op(struct Bitplane from[], struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy, uint8_t minterm);
+// cookie-cut through a single-plane mask, which has the same coordinates as the source
+void graphics_bitplane_blit_masked(struct Bitplane *from, struct Bitplane *cookie, struct Bitplane *to, int sx, int sy, int w, int h, int dx, int dy);
+void graphics_blit_masked(struct Bitplane from[], struct Bitplane *cookie, struct Bitplane to[], int mask, int sx, int sy, int w, int h, int dx, int dy);
 void graphics_copy_plane(struct Bitplane *from, struct Bitplane *to);
 
 // copper effects
@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <string.h>
 
 #include "heap.h"
 
@@ -16,11 +17,24 @@
 static uint8_t heap[HEAP_SIZE] __attribute__((aligned(sizeof(uintptr_t))));
 static void *heap_allocs[MAX_ALLOC];
 static int next_alloc_ptr; // index into heap_allocs
+static uint8_t *frame_top; // frame allocations grow down from here
+
+#if defined(BACKEND_SUPPORTS_PREFETCH) && !defined(NDEBUG)
+#include <pthread.h>
+static pthread_t frame_owner; // the thread that called heap_reset()
+#define assert_frame_owner() assert(pthread_equal(frame_owner, pthread_self()))
+#else
+#define assert_frame_owner()
+#endif
 
 // Heap management 
 void heap_reset() {
 	next_alloc_ptr = 0;
 	heap_allocs[0] = heap;
+	frame_top = heap + HEAP_SIZE;
+#if defined(BACKEND_SUPPORTS_PREFETCH) && !defined(NDEBUG)
+	frame_owner = pthread_self();
+#endif
 }
 
 void *heap_alloc(size_t size)
@@ -38,7 +52,7 @@ void *heap_alloc(size_t size)
 	next_alloc_ptr ++;
 	heap_allocs[next_alloc_ptr] = start + size;
 
-	if(((uint8_t *)heap_allocs[next_alloc_ptr]) >= heap + HEAP_SIZE) {
+	if(((uint8_t *)heap_allocs[next_alloc_ptr]) >= frame_top) {
 		backend_debug("heap_alloc: oom");
 		next_alloc_ptr --;
 		return NULL;
@@ -75,10 +89,73 @@ bool heap_free(void *data)
 	}
 }
 
-/*
 size_t heap_avail()
 {
-	return HEAP_SIZE - ( ((uint8_t *)heap_allocs[next_alloc_ptr]) - heap);
+	return frame_top - ((uint8_t *)heap_allocs[next_alloc_ptr]);
 }
-*/
 
+void *heap_frame_alloc(size_t size)
+{
+	assert_frame_owner();
+	size = align(size, sizeof(uintptr_t));
+
+	if(size > (size_t)(frame_top - (uint8_t *)heap_allocs[next_alloc_ptr])) {
+		backend_debug("heap_frame_alloc: oom");
+		return NULL;
+	}
+
+	frame_top -= size;
+	return frame_top;
+}
+
+void heap_frame_reset(void)
+{
+	assert_frame_owner();
+	frame_top = heap + HEAP_SIZE;
+}
+
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+struct heap_snapshot {
+	int from, to;
+	void *allocs[MAX_ALLOC];
+	uint8_t data[];
+};
+
+size_t heap_snapshot_size(int location)
+{
+	return sizeof(struct heap_snapshot) + ((uint8_t *)heap_allocs[next_alloc_ptr] - (uint8_t *)heap_allocs[location]);
+}
+
+void heap_snapshot_save(int location, void *dest)
+{
+	struct heap_snapshot *snap = dest;
+
+	assert(location <= next_alloc_ptr);
+
+	snap->from = location;
+	snap->to = next_alloc_ptr;
+	memcpy(snap->allocs, heap_allocs, sizeof(heap_allocs));
+	memcpy(snap->data, heap_allocs[location], (uint8_t *)heap_allocs[next_alloc_ptr] - (uint8_t *)heap_allocs[location]);
+}
+
+bool heap_snapshot_matches(const void *src)
+{
+	const struct heap_snapshot *snap = src;
+
+	return snap->from <= next_alloc_ptr
+		&& memcmp(snap->allocs, heap_allocs, (snap->from + 1) * sizeof(void *)) == 0;
+}
+
+void heap_snapshot_restore(const void *src)
+{
+	const struct heap_snapshot *snap = src;
+
+	assert(heap_snapshot_matches(src));
+	assert((uint8_t *)snap->allocs[snap->to] <= frame_top);
+
+	memcpy(heap_allocs, snap->allocs, sizeof(heap_allocs));
+	next_alloc_ptr = snap->to;
+	memcpy(heap_allocs[snap->from], snap->data, (uint8_t *)heap_allocs[snap->to] - (uint8_t *)heap_allocs[snap->from]);
+}
+#endif
@@ -1,9 +1,32 @@
 #include <stddef.h>
 
+/* Memory comes in three lifetimes:
+ *  - permanent: backend_reserve_memory(), only freed at shutdown;
+ *  - scene: the heap_alloc() stack, unwound when an effect or scene ends;
+ *  - frame: heap_frame_alloc(), all freed together at the start of the next
+ *    frame. Frame allocations come from the top of the heap and need not be
+ *    freed in any order.
+ * None of this is thread-safe. The frame arena in particular is main-thread
+ * only: worker threads (prefetch) must malloc their scratch instead.
+ */
 void heap_reset();
 void *heap_alloc(size_t size);
 void heap_pop();
 bool heap_free(void *data); // will fail if this wasn't the most recent allocation
 
+size_t heap_avail();
+
+void *heap_frame_alloc(size_t size);
+void heap_frame_reset(void);
+
 int heap_get_location(void);
 void heap_set_location(int ptr);
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+/* Everything allocated above 'location', for seeking. Restoring fails if the
+ * allocations below 'location' have changed since the save. */
+size_t heap_snapshot_size(int location);
+void heap_snapshot_save(int location, void *dest);
+bool heap_snapshot_matches(const void *src);
+void heap_snapshot_restore(const void *src);
+#endif
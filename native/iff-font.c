@@ -5,12 +5,16 @@
 #include <assert.h>
 
 #include "graphics.h"
+#include "blitter.h"
 #include "iff.h"
+#include "heap.h"
 #include "backend.h"
 #include "minmax.h"
 
-/* only use the first 3 bitplanes for the font. */
+/* only use the first 3 bitplanes for the font, and the 4th for their union,
+ * so that glyphs are cookie-cut rather than drawn as boxes. */
 #define FONT_BITPLANE_MASK (1 | 2 | 4)
+#define FONT_COOKIE_PLANE 3
 #define UNSCALED_KERNING 2
 
 struct position {
@@ -48,7 +52,22 @@ static void get_position(char c, struct position *dst)
 	dst->ey = pos->ey * font.scale;
 }
 
-bool ifffont_load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes)
+/* The scale the font is drawn at in planes of the given size. */
+int ifffont_scale_for(struct LoadedIff *iff, int width, int height)
+{
+	uint16_t w, h;
+
+	iff_get_dimensions(iff, &w, &h);
+
+	/* Make the font as big as possible without exceeding either screen
+	 * dimension and while remaining an integer multiple (because non-integer
+	 * scaling looks bad). */
+	/* TODO to be honest it looks pretty bad at any scaling other than 1 --
+	 * solution would be to use a real font */
+	return min(width / w, height / h);
+}
+
+static bool _load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes, bool draw)
 {
 	uint16_t w, h;
 
@@ -61,15 +80,10 @@ bool ifffont_load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t
 
 	font.positions = (struct position *)positions;
 
-	/* Make the font as big as possible without exceeding either screen
-	 * dimension and while remaining an integer multiple (because non-integer
-	 * scaling looks bad). */
-	/* TODO to be honest it looks pretty bad at any scaling other than 1 --
-	 * solution would be to use a real font */
-	int max_int_scale = min(planes[0].width / w, planes[0].height / h);
-	font.scale = max_int_scale;
+	font.scale = ifffont_scale_for(&font.iff, planes[0].width, planes[0].height);
 
-	iff_display(&font.iff, 0, 0, w * font.scale, h * font.scale, NULL, NULL, planes, 0);
+	if(draw)
+		iff_display(&font.iff, 0, 0, w * font.scale, h * font.scale, NULL, NULL, planes, 0, heap_frame_alloc(iff_scratch_size(&font.iff)));
 
 	font.firstchar = startchar;
 	font.numchars = numchars;
@@ -81,8 +95,23 @@ bool ifffont_load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t
 	font.kerning = UNSCALED_KERNING;
 	font.planes = planes;
 
+	struct Bitplane *cookie = &planes[FONT_COOKIE_PLANE];
+	graphics_bitplane_blit(&planes[0], cookie, 0, 0, cookie->width, cookie->height, 0, 0);
+	graphics_bitplane_blit_op(&planes[1], cookie, 0, 0, cookie->width, cookie->height, 0, 0, BLIT_MINTERM_A_OR_C);
+	graphics_bitplane_blit_op(&planes[2], cookie, 0, 0, cookie->width, cookie->height, 0, 0, BLIT_MINTERM_A_OR_C);
+
 	return true;
 }
+
+bool ifffont_load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes)
+{
+	return _load(file_idx, startchar, numchars, positions, planes, true);
+}
+
+bool ifffont_load_prerendered(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes)
+{
+	return _load(file_idx, startchar, numchars, positions, planes, false);
+}
 void ifffont_unload()
 {
 	iff_unload(&font.iff);
@@ -120,7 +149,7 @@ void ifffont_draw(int numchars, char *text, int x, int y, struct Bitplane dest_p
 		int char_width = (pos.ex - pos.sx) + 1;
 		int height = pos.ey - pos.sy;
 
-		graphics_blit(font.planes, dest_planes, FONT_BITPLANE_MASK, pos.sx, pos.sy, char_width, height, x, y);
+		graphics_blit_masked(font.planes, &font.planes[FONT_COOKIE_PLANE], dest_planes, FONT_BITPLANE_MASK, pos.sx, pos.sy, char_width, height, x, y);
 
 		x += (char_width + font.kerning);
 	}
@@ -1,8 +1,13 @@
 #include <stdbool.h>
 #include <inttypes.h>
 
+struct LoadedIff;
+
 bool ifffont_init();
 bool ifffont_load(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes);
+// As ifffont_load, for planes which already hold the font drawn at ifffont_scale_for()
+bool ifffont_load_prerendered(int file_idx, uint32_t startchar, uint32_t numchars, uint16_t *positions, struct Bitplane *planes);
+int ifffont_scale_for(struct LoadedIff *iff, int width, int height);
 void ifffont_unload();
 void ifffont_uninit();
 int ifffont_get_height();
@@ -135,12 +135,16 @@ static void scale_scanline(uint32_t *src, uint16_t src_w, uint32_t *dst, uint16_
 }
 
 
-static void iff_stretch(uint16_t src_w, uint16_t src_h, uint16_t dst_x, uint16_t dst_y, uint16_t dst_w, uint16_t dst_h, uint16_t nPlanes, int8_t *src, uint8_t compression, struct Bitplane *planes, int start_plane)
+static void iff_stretch(uint16_t src_w, uint16_t src_h, uint16_t dst_x, uint16_t dst_y, uint16_t dst_w, uint16_t dst_h, uint16_t nPlanes, int8_t *src, uint8_t compression, struct Bitplane *planes, int start_plane, int8_t *row_byte_data)
 {
 	int16_t row_bytes = ((src_w + 15) >> 4) << 1;
-	int8_t row_byte_data[row_bytes]; // NB this will overflow the stack on Pebble
 
 	int end_y = dst_y + dst_h;
+
+	for(int plane = 0; plane < nPlanes; plane++) {
+		planar_extent_add(&planes[plane + start_plane], dst_x, dst_y, dst_x + dst_w - 1, end_y - 1);
+	}
+
 	int intPart = (src_h / dst_h);
 	int fractPart = (src_h % dst_h);
 	int e = 0;
@@ -246,9 +250,20 @@ void iff_get_dimensions(struct LoadedIff *iff, uint16_t *w, uint16_t *h)
 }
 
 
-bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst_h, uint32_t *num_colours, uint32_t *palette_out, struct Bitplane *planes, int start_plane)
+size_t iff_scratch_size(struct LoadedIff *iff)
+{
+	/* One source row, rounded up for scale_scanline's 32-bit reads */
+	uint16_t src_w = be16toh(iff->bmhd->w);
+	return align(((src_w + 15) >> 4) << 1, sizeof(uint32_t));
+}
+
+bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst_h, uint32_t *num_colours, uint32_t *palette_out, struct Bitplane *planes, int start_plane, int8_t *scratch)
 {
-	/* Doesn't change palette, but will write it to palette_out if that argument is not null. */
+	/* Doesn't change palette, but will write it to palette_out if that argument is not null.
+	 * scratch must hold iff_scratch_size() bytes. */
+	if(scratch == NULL)
+		return false;
+
 	uint16_t src_w = be16toh(iff->bmhd->w);
 	uint16_t src_h = be16toh(iff->bmhd->h);
 
@@ -258,9 +273,15 @@ bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst
 	if(iff->bmhd->compression == 0)
 		fprintf(stderr, "uncompressed expand untested\n");
 
-	iff_stretch(src_w, src_h, dst_x, dst_y, dst_w, dst_h, nplanes, iff->body, iff->bmhd->compression, planes, start_plane);
+	iff_stretch(src_w, src_h, dst_x, dst_y, dst_w, dst_h, nplanes, iff->body, iff->bmhd->compression, planes, start_plane, scratch);
 
 	/* Copy the palette if requested */
+	iff_get_palette(iff, num_colours, palette_out);
+	return true;
+}
+
+void iff_get_palette(struct LoadedIff *iff, uint32_t *num_colours, uint32_t *palette_out)
+{
 	if(num_colours)
 		*num_colours = iff->cmap_count;
 
@@ -275,6 +296,5 @@ bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst
 			cmap += 3;
 		}
 	}
-	return true;
 }
 
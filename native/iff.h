@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stddef.h>
 
 struct BitmapHeader {
 	uint16_t w, h;             /* raster width & height in pixels      */
@@ -23,5 +24,8 @@ struct LoadedIff {
 bool iff_load(int file_idx, struct LoadedIff *iff);
 void iff_unload(struct LoadedIff *iff);
 void iff_get_dimensions(struct LoadedIff *iff, uint16_t *w, uint16_t *h);
-bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst_h, uint32_t *num_colours, uint32_t *palette_out, struct Bitplane *planes, int start_plane);
+size_t iff_scratch_size(struct LoadedIff *iff);
+// The palette alone, as iff_display gives it, without drawing anything.
+void iff_get_palette(struct LoadedIff *iff, uint32_t *num_colours, uint32_t *palette_out);
+bool iff_display(struct LoadedIff *iff, int dst_x, int dst_y, int dst_w, int dst_h, uint32_t *num_colours, uint32_t *palette_out, struct Bitplane *planes, int start_plane, int8_t *scratch);
 
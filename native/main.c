@@ -15,6 +15,9 @@
 #include "iff-font.h"
 #include "posix_sdl2_backend.h"
 #include "heap.h"
+#ifdef BACKEND_SUPPORTS_MANIFEST
+#include "manifest.h"
+#endif
 #include "tinf/src/tinf.h"
 
 #define DEFAULT_WIDTH 640
@@ -28,6 +31,13 @@
 #define OPT_WIDTH 6
 #define OPT_HEIGHT 7
 #define OPT_WAD 8
+#define OPT_FIXED_STEP 9
+#define OPT_FRAMES 10
+#define OPT_SEED 11
+#define OPT_AUDIO_CLOCK 12
+#define OPT_AUDIO_LATENCY 13
+#define OPT_LOOP 14
+#define OPT_SEEK 15
 
 struct option options[] = {
 	{"fullscreen", no_argument, NULL, OPT_FULLSCREEN},
@@ -38,6 +48,13 @@ struct option options[] = {
 	{"width", required_argument, NULL, OPT_WIDTH},
 	{"height", required_argument, NULL, OPT_HEIGHT},
 	{"wad", required_argument, NULL, OPT_WAD},
+	{"fixed-step", required_argument, NULL, OPT_FIXED_STEP},
+	{"frames", required_argument, NULL, OPT_FRAMES},
+	{"seed", required_argument, NULL, OPT_SEED},
+	{"audio-clock", no_argument, NULL, OPT_AUDIO_CLOCK},
+	{"audio-latency", required_argument, NULL, OPT_AUDIO_LATENCY},
+	{"loop", no_argument, NULL, OPT_LOOP},
+	{"seek", no_argument, NULL, OPT_SEEK},
 	{0, 0, 0, 0}
 };
 
@@ -52,6 +69,13 @@ static void help() {
 	printf("  --width <x>      : set display width\n");
 	printf("  --height <x>     : set display height\n");
 	printf("  --wad            : use alternative wad file (sota.wad)\n");
+	printf("  --fixed-step <x> : advance x ms of demo time per frame, as fast as possible\n");
+	printf("  --frames <x>     : stop after x frames\n");
+	printf("  --seed <x>       : seed the random number generator\n");
+	printf("  --audio-clock    : time the demo from the music rather than the clock\n");
+	printf("  --audio-latency <x> : the sound output lags by a further x ms\n");
+	printf("  --loop           : play the demo over and over\n");
+	printf("  --seek           : keep keyframes so the cursor keys seek quickly\n");
 }
 
 int main(int argc, char **argv) {
@@ -60,6 +84,10 @@ int main(int argc, char **argv) {
 	int start_ms = 0;
 	char *wad_filename = 0;
 	char *start_scene_name = NULL;
+	int fixed_step_ms = 0;
+	int max_frames = 0;
+	bool audio_clock = false;
+	int audio_latency_ms = 0;
 
 	int width = DEFAULT_WIDTH;
 	int height = DEFAULT_HEIGHT;
@@ -98,6 +126,29 @@ int main(int argc, char **argv) {
 			case OPT_WAD:
 				wad_filename = optarg;
 				break;
+			case OPT_FIXED_STEP:
+				fixed_step_ms = atoi(optarg);
+				break;
+			case OPT_FRAMES:
+				max_frames = atoi(optarg);
+				break;
+			case OPT_SEED:
+				posix_backend_seed_random(strtoull(optarg, NULL, 0));
+				break;
+			case OPT_AUDIO_CLOCK:
+				audio_clock = true;
+				break;
+			case OPT_AUDIO_LATENCY:
+				audio_latency_ms = atoi(optarg);
+				break;
+			case OPT_LOOP:
+				posix_backend_set_loop(true);
+				break;
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+			case OPT_SEEK:
+				choreography_enable_snapshots(true);
+				break;
+#endif
 			case -1:
 				break;
 		}
@@ -105,6 +156,8 @@ int main(int argc, char **argv) {
 
 	heap_reset();
 	tinf_init();
+	posix_backend_set_playback(fixed_step_ms, max_frames);
+	posix_backend_set_audio_clock(audio_clock);
 
 	if(backend_init(width, height, fullscreen, wad_filename) == false) {
 		fprintf(stderr, "couldn't init backend\n");
@@ -128,6 +181,7 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "couldn't init sound\n");
 		return 1;
 	}
+	sound_set_latency_ms(audio_latency_ms);
 
 	if(choreography_init() == false) {
 		fprintf(stderr, "couldn't load choreography\n");
@@ -138,6 +192,13 @@ int main(int argc, char **argv) {
 	anim_init();
 	scene_init();
 
+#ifdef BACKEND_SUPPORTS_MANIFEST
+	if(anim_reserve_vertices(manifest_max_vertices()) == false) {
+		fprintf(stderr, "couldn't reserve animation buffers\n");
+		return 1;
+	}
+#endif
+
 	backend_run(start_ms, start_scene_name);
 
 #if 0
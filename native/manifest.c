@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "backend.h"
+#include "manifest.h"
+
+struct manifest_header {
+	char magic[4]; // "mnfs"
+	uint32_t num_scenes;
+	uint32_t max_screens;
+	uint32_t max_vertices;
+	// scenes follow
+};
+
+static struct manifest_header *manifest;
+
+static inline const struct manifest_scene *first_scene(void)
+{
+	return (const struct manifest_scene *)(manifest + 1);
+}
+
+static inline const struct manifest_scene *next_scene(const struct manifest_scene *scene)
+{
+	return (const struct manifest_scene *)((const uint8_t *)scene + scene->length);
+}
+
+bool manifest_init(void *data, size_t size)
+{
+	struct manifest_header *header = data;
+
+	manifest = NULL;
+
+	if(size < sizeof(struct manifest_header) || memcmp(header->magic, "mnfs", 4) != 0) {
+		backend_debug("manifest: bad header");
+		return false;
+	}
+
+	/* Check the entries lie within the data, so lookups needn't. */
+	const uint8_t *end = (const uint8_t *)data + size;
+	const struct manifest_scene *scene = (const struct manifest_scene *)(header + 1);
+
+	for(uint32_t i = 0; i < header->num_scenes; i++) {
+		if((const uint8_t *)scene + sizeof(struct manifest_scene) > end
+				|| scene->length < sizeof(struct manifest_scene) + (scene->num_files * sizeof(uint32_t))
+				|| scene->length % sizeof(uint32_t) != 0
+				|| (const uint8_t *)scene + scene->length > end) {
+			backend_debug("manifest: bad entry for scene %u", i);
+			return false;
+		}
+
+		scene = (const struct manifest_scene *)((const uint8_t *)scene + scene->length);
+	}
+
+	manifest = header;
+	return true;
+}
+
+// Scenes are found by start time: names are truncated, so needn't be unique.
+const struct manifest_scene *manifest_find_scene(uint32_t ms)
+{
+	if(manifest == NULL)
+		return NULL;
+
+	const struct manifest_scene *scene = first_scene();
+	for(uint32_t i = 0; i < manifest->num_scenes; i++) {
+		if(scene->ms == ms)
+			return scene;
+
+		scene = next_scene(scene);
+	}
+
+	return NULL;
+}
+
+const struct manifest_scene *manifest_find_next_scene(uint32_t ms)
+{
+	const struct manifest_scene *next = NULL;
+
+	if(manifest == NULL)
+		return NULL;
+
+	const struct manifest_scene *scene = first_scene();
+	for(uint32_t i = 0; i < manifest->num_scenes; i++) {
+		if(scene->ms > ms && (next == NULL || scene->ms < next->ms))
+			next = scene;
+
+		scene = next_scene(scene);
+	}
+
+	return next;
+}
+
+int manifest_num_scenes(void)
+{
+	return manifest ? manifest->num_scenes : 0;
+}
+
+const struct manifest_scene *manifest_get_scene(int idx)
+{
+	if(manifest == NULL || idx < 0 || (uint32_t)idx >= manifest->num_scenes)
+		return NULL;
+
+	const struct manifest_scene *scene = first_scene();
+	while(idx--)
+		scene = next_scene(scene);
+
+	return scene;
+}
+
+int manifest_max_screens(void)
+{
+	return manifest ? manifest->max_screens : 0;
+}
+
+int manifest_max_vertices(void)
+{
+	return manifest ? manifest->max_vertices : 0;
+}
@@ -0,0 +1,34 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+/* What each scene needs at runtime, worked out by build_demo.py (see
+ * manifest.py for the format) so that pools can be sized up front. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct manifest_scene {
+	uint32_t length; // of this entry, including the file list
+	uint32_t ms;
+	char name[8];
+	uint8_t bitplane_style[6];
+	uint16_t screens; // bitplane pool needed, in screen-sized planes
+	uint32_t effect_mask; // 1 << effect number, for each effect started
+	uint32_t max_vertices;
+	uint32_t mbit_bytes; // largest decompressed mbit plane
+	uint32_t effect_heap_bytes;
+	uint32_t num_files;
+	uint32_t files[];
+};
+
+bool manifest_init(void *data, size_t size);
+const struct manifest_scene *manifest_find_scene(uint32_t ms);
+const struct manifest_scene *manifest_find_next_scene(uint32_t ms); // first after ms
+int manifest_num_scenes(void);
+const struct manifest_scene *manifest_get_scene(int idx);
+// Over all scenes. 0 if there is no manifest.
+int manifest_max_screens(void);
+int manifest_max_vertices(void);
+
+#endif // MANIFEST_H
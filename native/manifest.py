@@ -0,0 +1,121 @@
+"""
+What each scene needs at runtime, so the player can size its pools up front.
+
+Format (all fields 4 bytes unless noted):
+
+'mnfs'
+number of scenes
+most bitplane screens needed by any scene
+most vertices in any polygon
+then for each scene:
+	length of this entry, including the file list
+	ms the scene starts
+	name (8 bytes)
+	bitplane styles (6 x 1 byte)
+	bitplane screens needed (2 bytes): 1x1 planes count 1, 2x1 count 2, 2x2 count 4
+	effects started, as a mask of (1 << effect number)
+	most vertices in any polygon
+	largest decompressed mbit plane, in bytes
+	heap used by effect data, in bytes
+	number of files
+	index of each file used
+"""
+import struct
+
+# Screens per bitplane style (off, 1x1, 2x1, 2x2)
+STYLE_SCREENS = (0, 1, 2, 4)
+
+def anim_max_vertices(filedata):
+	""" Mirrors anim_max_vertices() in anim.c """
+	num_frames = struct.unpack('>H', filedata[:2])[0]
+	data = filedata[2 + num_frames * 2:]
+	pos = 0
+	max_vertices = 0
+
+	while pos < len(data):
+		num_objects = data[pos]
+		pos += 1
+
+		while num_objects and pos + 2 <= len(data):
+			draw_cmd = data[pos] & 0xf0
+			pos += 1
+
+			if draw_cmd == 0xd0:
+				num_vertices = data[pos]
+				max_vertices = max(max_vertices, num_vertices)
+				pos += 1 + num_vertices * 2
+			elif draw_cmd in (0xe0, 0xf0):
+				pos += 6
+			else:
+				return max_vertices
+
+			num_objects -= 1
+
+	return max_vertices
+
+class ManifestScene:
+	def __init__(self, name, ms, styles):
+		self.name = name
+		self.ms = ms
+		self.styles = styles
+		self.effect_mask = 0
+		self.max_vertices = 0
+		self.mbit_bytes = 0
+		self.effect_heap_bytes = 0
+		self.files = []
+
+	def screens(self):
+		return sum(STYLE_SCREENS[style] for style in self.styles)
+
+	def serialise(self, endian):
+		entry = struct.pack(endian + 'I8s6BHIIIII', self.ms, self.name.encode('utf-8'), *self.styles,
+				self.screens(), self.effect_mask, self.max_vertices, self.mbit_bytes,
+				self.effect_heap_bytes, len(self.files))
+		entry += struct.pack(endian + ('I' * len(self.files)), *self.files)
+		return struct.pack(endian + 'I', len(entry) + 4) + entry
+
+class Manifest:
+	def __init__(self, endian):
+		self.scenes = []
+		self.endian = endian
+
+	def start_scene(self, name, ms, styles):
+		self.scenes.append(ManifestScene(name, ms, styles))
+
+	@property
+	def scene(self):
+		return self.scenes[-1] if self.scenes else None
+
+	def use_file(self, idx):
+		if self.scene and idx not in self.scene.files:
+			self.scene.files.append(idx)
+
+	def use_anim(self, idx, filedata):
+		self.use_file(idx)
+		if self.scene:
+			self.scene.max_vertices = max(self.scene.max_vertices, anim_max_vertices(filedata))
+
+	def use_mbit(self, idx, filedata):
+		self.use_file(idx)
+		width, height = struct.unpack(self.endian + 'HH', filedata[4:8])
+		if self.scene:
+			self.scene.mbit_bytes = max(self.scene.mbit_bytes, (width * height) // 8)
+
+	def use_effect(self, effect_num, heap_bytes):
+		if self.scene:
+			self.scene.effect_mask |= 1 << effect_num
+			self.scene.effect_heap_bytes = max(self.scene.effect_heap_bytes, heap_bytes)
+
+	def serialise(self):
+		max_screens = max((scene.screens() for scene in self.scenes), default=0)
+		max_vertices = max((scene.max_vertices for scene in self.scenes), default=0)
+
+		encoded = [b'mnfs', struct.pack(self.endian + 'III', len(self.scenes), max_screens, max_vertices)]
+		encoded.extend(scene.serialise(self.endian) for scene in self.scenes)
+		return b''.join(encoded)
+
+	def dump(self):
+		print('Scene needs:')
+		for scene in self.scenes:
+			print('  %-22s %d screens, %d vertices, %d files, effects %#x' % (scene.name, scene.screens(),
+				scene.max_vertices, len(scene.files), scene.effect_mask))
@@ -1,9 +1,11 @@
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "tinf/src/tinf.h"
 
 #include "backend.h"
+#include "graphics.h"
 #include "heap.h"
 #include "mbit.h"
 
@@ -14,6 +16,8 @@ static void draw_1bit(uint16_t src_width, uint16_t src_height, uint8_t *src_data
 
 	int src_stride = src_width / 8;
 
+	planar_extent_add(dst_bitplane, dstx, dsty, dstx + src_width - 1, dsty + src_height - 1);
+
 	for(int y = 0; y < src_height; y++) {
 		for(int x = 0; x < src_stride; x++) {
 			dst[x] = src[x];
@@ -23,38 +27,88 @@ static void draw_1bit(uint16_t src_width, uint16_t src_height, uint8_t *src_data
 	}
 }
 
+void mbit_set_palette(void *mbit_source, void(*set_palette_from_argb)(int num, uint32_t *in))
+{
+	struct multibit_compressed *compressed_resource = mbit_source;
+
+	// Immediately after the fixed-length data we have palette entries.
+	set_palette_from_argb(compressed_resource->num_palette, (uint32_t *)(compressed_resource + 1));
+}
+
 void mbit_display(void *mbit_source, void(*set_palette_from_argb)(int num, uint32_t *in), struct Bitplane *dest_planes) {
 	/*
 	 * Load an mbitmap, copy it to the bitplanes, and change the palette. 
 	*/
 	struct multibit_compressed *compressed_resource = mbit_source;
 
-	// TODO we need a backend_allocate_temporary which allocates memory which is freed on the next frame. Or something -- we now have three types of memory allocation: for bitplanes, for long-running stuff (backend_reserve_memory), plus this new thing, so that's potentially bad.
-
 	// Immediately after the fixed-length data we have palette entries.
 	uint8_t *ptr = ((uint8_t *)(compressed_resource)) + (sizeof(struct multibit_compressed));
-	set_palette_from_argb(compressed_resource->num_palette, (uint32_t *)ptr);
+	mbit_set_palette(mbit_source, set_palette_from_argb);
 
 	ptr += (compressed_resource->num_palette * sizeof(uint32_t));
 	// After the palette comes the lengths of each bitplane, and after these come the planes themselves.
 	uint32_t *plane_lengths = (uint32_t *)ptr;
 	ptr += (compressed_resource->num_planes * sizeof(uint32_t));
 
-	// decompressor data structure
-	int loc = heap_get_location();
-	void *tinf_internal_data = heap_alloc(tinf_data_size());
-	uint8_t *decompressed = heap_alloc((compressed_resource->width * compressed_resource->height) / 8);
+	// decompressor data structure, and somewhere to decompress to
+	void *tinf_internal_data = heap_frame_alloc(tinf_data_size());
+	uint8_t *decompressed = heap_frame_alloc((compressed_resource->width * compressed_resource->height) / 8);
+
+	if(tinf_internal_data == NULL || decompressed == NULL)
+		return;
 
 	//APP_LOG(APP_LOG_LEVEL_DEBUG, "bitmap width %d dest plane0 stride %d", compressed_resource->width, backend_bitplane[0].stride);
 
 	for(int i = 0; i < compressed_resource->num_planes; i++) {
-		unsigned int uncompressed_size_out;
+		unsigned int uncompressed_size_out = (compressed_resource->width * compressed_resource->height) / 8;
 		tinf_zlib_uncompress(decompressed, &uncompressed_size_out, ptr, plane_lengths[i], tinf_internal_data);
 
 		draw_1bit(compressed_resource->width, compressed_resource->height, decompressed, &dest_planes[i], 0, 0);
 
 		ptr += plane_lengths[i];
 	}
-	
-	heap_set_location(loc);
 }
+
+#ifdef BACKEND_SUPPORTS_PREFETCH
+size_t mbit_decoded_size(void *mbit_source)
+{
+	struct multibit_compressed *compressed_resource = mbit_source;
+
+	return compressed_resource->num_planes * ((compressed_resource->width * compressed_resource->height) / 8);
+}
+
+bool mbit_decode(void *mbit_source, uint8_t *decoded, void *tinf_data)
+{
+	struct multibit_compressed *compressed_resource = mbit_source;
+	size_t plane_size = (compressed_resource->width * compressed_resource->height) / 8;
+
+	uint8_t *ptr = ((uint8_t *)(compressed_resource)) + (sizeof(struct multibit_compressed));
+	ptr += (compressed_resource->num_palette * sizeof(uint32_t));
+	uint32_t *plane_lengths = (uint32_t *)ptr;
+	ptr += (compressed_resource->num_planes * sizeof(uint32_t));
+
+	for(int i = 0; i < compressed_resource->num_planes; i++) {
+		unsigned int uncompressed_size_out = plane_size;
+		if(tinf_zlib_uncompress(decoded, &uncompressed_size_out, ptr, plane_lengths[i], tinf_data) != TINF_OK)
+			return false;
+
+		decoded += plane_size;
+		ptr += plane_lengths[i];
+	}
+
+	return true;
+}
+
+void mbit_display_decoded(void *mbit_source, uint8_t *decoded, void(*set_palette_from_argb)(int num, uint32_t *in), struct Bitplane *dest_planes)
+{
+	struct multibit_compressed *compressed_resource = mbit_source;
+	size_t plane_size = (compressed_resource->width * compressed_resource->height) / 8;
+
+	mbit_set_palette(mbit_source, set_palette_from_argb);
+
+	for(int i = 0; i < compressed_resource->num_planes; i++) {
+		draw_1bit(compressed_resource->width, compressed_resource->height, decoded, &dest_planes[i], 0, 0);
+		decoded += plane_size;
+	}
+}
+#endif
@@ -11,5 +11,16 @@ struct multibit_compressed {
 };
 
 
+// Just the palette change of mbit_display.
+void mbit_set_palette(void *mbit_source, void(*set_palette_from_argb)(int num, uint32_t *in));
 void mbit_display(void *mbit_source, void(*set_palette_from_argb)(int num, uint32_t *in), struct Bitplane *dest_planes);
 
+#ifdef BACKEND_SUPPORTS_PREFETCH
+/* Split version of mbit_display: mbit_decode decompresses every plane into
+ * 'decoded' (mbit_decoded_size bytes) without touching the display, so it
+ * can be done ahead of time. tinf_data is tinf_data_size() bytes. */
+size_t mbit_decoded_size(void *mbit_source);
+bool mbit_decode(void *mbit_source, uint8_t *decoded, void *tinf_data);
+void mbit_display_decoded(void *mbit_source, uint8_t *decoded, void(*set_palette_from_argb)(int num, uint32_t *in), struct Bitplane *dest_planes);
+#endif
+
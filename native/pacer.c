@@ -0,0 +1,130 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+
+#include "backend.h"
+#include "pacer.h"
+
+#define NS_PER_S 1000000000ULL
+
+static struct {
+	bool vsync;
+	uint64_t interval_ns; // measured refresh interval with vsync, requested frame interval without
+	uint64_t frame_start_ns;
+	uint64_t predicted_ns; // when the current frame should be shown
+	uint64_t last_present_ns;
+
+	// statistics
+	unsigned frames;
+	unsigned missed;
+	uint64_t worst_late_ns;
+} pacer;
+
+void pacer_init(bool vsync, int refresh_hz, uint64_t frame_interval_ns)
+{
+	pacer.vsync = vsync && refresh_hz > 0;
+	pacer.interval_ns = pacer.vsync ? NS_PER_S / refresh_hz : frame_interval_ns;
+	pacer.last_present_ns = 0;
+	pacer.frames = pacer.missed = 0;
+	pacer.worst_late_ns = 0;
+}
+
+uint64_t pacer_now_ns(void)
+{
+#ifdef NO_POSIX_REALTIME_CLOCKS
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return ((uint64_t)tv.tv_sec * NS_PER_S) + ((uint64_t)tv.tv_usec * 1000);
+#else
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return ((uint64_t)tp.tv_sec * NS_PER_S) + tp.tv_nsec;
+#endif
+}
+
+void pacer_sleep_until(uint64_t deadline_ns)
+{
+#ifdef NO_POSIX_REALTIME_CLOCKS
+	uint64_t now = pacer_now_ns();
+	if(deadline_ns <= now)
+		return;
+
+	struct timespec delay = {(deadline_ns - now) / NS_PER_S, (deadline_ns - now) % NS_PER_S};
+	while(nanosleep(&delay, &delay) == -1 && errno == EINTR)
+		;
+#else
+	/* Absolute, so an interrupted sleep resumes without drifting. */
+	struct timespec deadline = {deadline_ns / NS_PER_S, deadline_ns % NS_PER_S};
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		;
+#endif
+}
+
+uint64_t pacer_frame_start(void)
+{
+	uint64_t now = pacer_now_ns();
+
+	pacer.frame_start_ns = now;
+
+	if(pacer.vsync && pacer.last_present_ns) {
+		/* The next vblank after the last one which is still to come. */
+		uint64_t intervals = ((now - pacer.last_present_ns) / pacer.interval_ns) + 1;
+		pacer.predicted_ns = pacer.last_present_ns + (intervals * pacer.interval_ns);
+	} else {
+		pacer.predicted_ns = now;
+	}
+
+	return pacer.predicted_ns;
+}
+
+void pacer_frame_presented(void)
+{
+	uint64_t now = pacer_now_ns();
+	uint64_t late_ns = 0;
+
+	pacer.frames++;
+
+	if(pacer.vsync) {
+		/* Shown at a later vblank than predicted? */
+		if(pacer.last_present_ns && now > pacer.predicted_ns + (pacer.interval_ns / 2)) {
+			late_ns = now - pacer.predicted_ns;
+		}
+
+		/* Track the real refresh rate, ignoring dropped frames and stalls. */
+		uint64_t delta = now - pacer.last_present_ns;
+		if(pacer.last_present_ns && delta > pacer.interval_ns / 2 && delta < pacer.interval_ns + (pacer.interval_ns / 2)) {
+			pacer.interval_ns = ((pacer.interval_ns * 15) + delta) / 16;
+		}
+	} else if(now > pacer.frame_start_ns + pacer.interval_ns) {
+		late_ns = now - (pacer.frame_start_ns + pacer.interval_ns);
+	}
+
+	if(late_ns) {
+		pacer.missed++;
+		if(late_ns > pacer.worst_late_ns)
+			pacer.worst_late_ns = late_ns;
+	}
+
+	pacer.last_present_ns = now;
+}
+
+uint64_t pacer_next_frame_ns(void)
+{
+	if(pacer.vsync)
+		return 0;
+
+	return pacer.frame_start_ns + pacer.interval_ns;
+}
+
+void pacer_report(void)
+{
+	backend_debug("pacer: %s, %u.%03u ms interval, %u of %u frames missed their deadline (worst by %u.%03u ms)",
+			pacer.vsync ? "vsync" : "timed",
+			(unsigned)(pacer.interval_ns / NS_PER_MS), (unsigned)((pacer.interval_ns % NS_PER_MS) / 1000),
+			pacer.missed, pacer.frames,
+			(unsigned)(pacer.worst_late_ns / NS_PER_MS), (unsigned)((pacer.worst_late_ns % NS_PER_MS) / 1000));
+}
@@ -0,0 +1,26 @@
+#ifndef PACER_H
+#define PACER_H
+
+/* Frame pacing against a monotonic nanosecond clock. With vsync the display
+ * paces us, and the pacer predicts when the frame being drawn will be shown;
+ * without it, frames are started at a fixed interval. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define NS_PER_MS 1000000ULL
+
+void pacer_init(bool vsync, int refresh_hz, uint64_t frame_interval_ns);
+uint64_t pacer_now_ns(void);
+void pacer_sleep_until(uint64_t deadline_ns);
+
+// Call at the start of a frame. Returns when the frame should appear on screen.
+uint64_t pacer_frame_start(void);
+// Call immediately after presenting the frame.
+void pacer_frame_presented(void);
+// When to start the next frame, or 0 to start it straight away.
+uint64_t pacer_next_frame_ns(void);
+
+void pacer_report(void);
+
+#endif // PACER_H
@@ -0,0 +1,106 @@
+#include <string.h>
+
+#include "backend.h"
+#include "palette.h"
+
+static uint32_t generation;
+
+/* There's no cached copy here: copper effects write the backend palette
+ * directly, so only the backend knows what is on screen. The backend skips
+ * entries that haven't changed. */
+static void palette_update(uint32_t *elements)
+{
+	uint32_t shown[PALETTE_SIZE];
+
+	backend_get_palette(PALETTE_SIZE, shown);
+	if(memcmp(shown, elements, sizeof(shown)) != 0)
+		generation++;
+
+	backend_set_palette(PALETTE_SIZE, elements);
+}
+
+void palette_set(int num_elements, uint32_t *elements)
+{
+	uint32_t new_palette[PALETTE_SIZE];
+
+	if(num_elements > PALETTE_SIZE)
+		num_elements = PALETTE_SIZE;
+
+	for(int i = 0; i < num_elements; i++)
+		new_palette[i] = elements[i];
+	for(int i = num_elements; i < PALETTE_SIZE; i++)
+		new_palette[i] = 0xff000000;
+
+	palette_update(new_palette);
+}
+
+void palette_get(int num_elements, uint32_t *elements)
+{
+	if(num_elements > PALETTE_SIZE)
+		num_elements = PALETTE_SIZE;
+
+	backend_get_palette(num_elements, elements);
+}
+
+uint32_t palette_get_element(int idx)
+{
+	uint32_t shown[PALETTE_SIZE];
+
+	backend_get_palette(PALETTE_SIZE, shown);
+	return shown[idx];
+}
+
+uint32_t palette_generation(void)
+{
+	return generation;
+}
+
+void palette_fade_init(struct palette_fade *fade, int count, uint32_t *from, uint32_t *to, int total_steps)
+{
+	if(count > PALETTE_SIZE)
+		count = PALETTE_SIZE;
+	if(total_steps < 1)
+		total_steps = 1;
+
+	fade->count = count;
+	fade->total_steps = total_steps;
+
+	for(int channel = 0; channel < 4; channel++) {
+		int shift = channel * 8;
+
+		for(int i = 0; i < PALETTE_SIZE; i++) {
+			int byte_from = i < count ? (from[i] >> shift) & 0xff : 0;
+			int byte_to = i < count ? (to[i] >> shift) & 0xff : 0;
+
+			fade->start[channel][i] = byte_from;
+			fade->delta[channel][i] = ((byte_to - byte_from) * 65536) / total_steps;
+		}
+	}
+}
+
+void palette_fade_step(struct palette_fade *fade, int current_step)
+{
+	if(current_step < 0 || current_step > fade->total_steps)
+		return;
+
+	int32_t lerped[4][PALETTE_SIZE];
+	uint32_t new_palette[PALETTE_SIZE];
+
+	/* Every channel of every entry in one pass; unused entries have zero deltas. */
+	for(int channel = 0; channel < 4; channel++) {
+		for(int i = 0; i < PALETTE_SIZE; i++) {
+			lerped[channel][i] = ((fade->start[channel][i] << 16)
+					+ (fade->delta[channel][i] * current_step) + 0x8000) >> 16;
+		}
+	}
+
+	backend_get_palette(PALETTE_SIZE, new_palette);
+	for(int i = 0; i < fade->count; i++) {
+		new_palette[i] = ((uint32_t)lerped[3][i] << 24)
+			| ((uint32_t)lerped[2][i] << 16)
+			| ((uint32_t)lerped[1][i] << 8)
+			| ((uint32_t)lerped[0][i]);
+	}
+
+	palette_update(new_palette);
+}
@@ -0,0 +1,34 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+/* The palette as the demo sees it. All palette changes go through here so
+ * the backend is updated once per change, and so that anything derived from
+ * the palette can tell when it changed. Reads return what the backend is
+ * showing, including any copper changes. */
+
+#include <inttypes.h>
+
+// 32 colour registers, directly modelling the Amiga (OCS / ECS). The backend derives the EHB half-bright copies.
+#define PALETTE_SIZE 32
+
+/* A fade between two palettes, precomputed as 16.16 per-channel deltas.
+ * Channels are stored separately so that stepping is one flat loop. */
+struct palette_fade {
+	int count;
+	int total_steps;
+	uint8_t start[4][PALETTE_SIZE];
+	int32_t delta[4][PALETTE_SIZE];
+};
+
+// Entries from num_elements onwards are set to black.
+void palette_set(int num_elements, uint32_t *elements);
+void palette_get(int num_elements, uint32_t *elements);
+uint32_t palette_get_element(int idx);
+
+// Incremented whenever the palette changes.
+uint32_t palette_generation(void);
+
+void palette_fade_init(struct palette_fade *fade, int count, uint32_t *from, uint32_t *to, int total_steps);
+void palette_fade_step(struct palette_fade *fade, int current_step);
+
+#endif // PALETTE_H
@@ -3,6 +3,15 @@
 
 #include "pcgrandom.h"
 
+void pcg32_srandom_r(pcg32_random_t *rng, uint64_t initstate, uint64_t initseq)
+{
+	rng->state = 0U;
+	rng->inc = (initseq << 1u) | 1u;
+	pcg32_random_r(rng);
+	rng->state += initstate;
+	pcg32_random_r(rng);
+}
+
 uint32_t pcg32_random_r(pcg32_random_t *rng)
 {
 	uint64_t oldstate = rng->state;
@@ -3,3 +3,4 @@
 typedef struct { uint64_t state; uint64_t inc; } pcg32_random_t;
 
 uint32_t pcg32_random_r(pcg32_random_t *rng);
+void pcg32_srandom_r(pcg32_random_t *rng, uint64_t initstate, uint64_t initseq);
@@ -9,6 +9,7 @@
 #include "../../backend.h"
 #include "../../mbit.h"
 #include "../../graphics.h"
+#include "../../palette.h"
 
 #define NUM_BITPLANES 4
 
@@ -147,6 +148,7 @@ struct Bitplane *backend_allocate_bitplane(int idx, int width, int height)
 		backend_bitplane[idx].stride = align(width, 8) / 8;
 		backend_bitplane[idx].data = backend_bitplane[idx].data_start
 			= heap_alloc(backend_bitplane[idx].height * backend_bitplane[idx].stride);
+		planar_extent_full(&backend_bitplane[idx]);
 	} else {
 		backend_bitplane[idx].width = backend_bitplane[idx].height = backend_bitplane[idx].stride = 0;
 		backend_bitplane[idx].data = backend_bitplane[idx].data_start = 0;
@@ -171,6 +173,7 @@ void backend_copy_bitplane(struct Bitplane *dst, struct Bitplane *src)
 {
 	if(dst->height == src->height && dst->stride == src->stride) {
 		memcpy(dst->data_start, src->data_start, src->stride * src->height);
+		dst->drawn = src->drawn;
 	}
 }
 
@@ -224,7 +227,7 @@ bool backend_font_load(int file_idx, uint32_t startchar, uint32_t numchars, uint
 		font_bitplanes[i].data_start = font_bitplanes[i].data = heap_alloc(stride * mbit->height);
 	}
 
-	mbit_display(mbit, &backend_set_palette, font_bitplanes);
+	mbit_display(mbit, &palette_set, font_bitplanes);
 
 	// TODO we can't unload the file because stuff has been allocated after it. 
 	// backend_wad_unload_file(mbit);
@@ -40,7 +40,7 @@ static uint8_t *read_wad_portion(uint32_t start, size_t count)
 	return data;
 }
 
-void *backend_wad_load_choreography_for_scene_ms(int ms)
+void *backend_wad_load_choreography_for_scene_ms(int ms, size_t *size_out)
 {
 	uint32_t choreography_offset = wad_get_choreography_offset(wad);
 
@@ -56,14 +56,24 @@ void *backend_wad_load_choreography_for_scene_ms(int ms)
 	APP_LOG(APP_LOG_LEVEL_DEBUG, "choreography offset %lu scene offset %lu amt read %lu data %p",
 			choreography_offset, scene_offset, next_scene_offset - scene_offset, data);
 
+	if(size_out != NULL)
+		*size_out = next_scene_offset - scene_offset;
+
 	return data;
 }
 
+int backend_wad_get_file_count(void)
+{
+	return wad_get_file_count(wad);
+}
+
 static void sotaface_load_scene_choreography()
 {
 	/* Load the relevant choreography portion */
-	choreography = backend_wad_load_choreography_for_scene_ms(ms);
-	choreography_prepare_to_run(choreography, ms);
+	size_t size;
+
+	choreography = backend_wad_load_choreography_for_scene_ms(ms, &size);
+	choreography_prepare_to_run(choreography, size, ms);
 }
 
 static void sotaface_root_layer_update(Layer *root, GContext *ctx)
@@ -85,6 +95,7 @@ static void sotaface_root_layer_update(Layer *root, GContext *ctx)
 	}
 
 	APP_LOG(APP_LOG_LEVEL_DEBUG, "do frame"); // TODO
+	heap_frame_reset();
 	scene_has_ended = choreography_do_frame(ms);
 	APP_LOG(APP_LOG_LEVEL_DEBUG, "eof? %d. render...", scene_has_ended); // TODO
 	render_bitplanes(root, ctx);
@@ -153,6 +164,8 @@ static void sotaface_init(void)
 	/* Load the wad's central directory */
 	wad_handle = resource_get_handle(RESOURCE_ID_wad);
 	wad = read_wad_portion(0, WAD_CENTRAL_DIRECTORY_SIZE);
+	if(!wad_check_header(wad))
+		APP_LOG(APP_LOG_LEVEL_ERROR, "wad is in an old format; rebuild it");
 
 	/* Start at ms = 0 for now */
 	//ms = 28000;
@@ -195,9 +208,33 @@ void backend_set_new_scene()
 
 void *backend_wad_load_file(int file_idx, size_t *size_out)
 {
+	if(wad_file_is_compressed(wad, file_idx)) {
+		APP_LOG(APP_LOG_LEVEL_DEBUG, "backend_wad_load_file: %d is compressed", file_idx);
+		return NULL;
+	}
+
 	return read_wad_portion(wad_get_file_offset(wad, file_idx), wad_get_file_size(wad, file_idx));
 }
 
+void *backend_reserve_memory(size_t size)
+{
+	void *mem = malloc(size);
+	if(mem == NULL) {
+		APP_LOG(APP_LOG_LEVEL_DEBUG, "backend_reserve_memory: couldn't alloc %u", (unsigned)size);
+	}
+
+	return mem;
+}
+
+void *backend_resize_reserved_memory(void *mem, size_t old_size, size_t size)
+{
+	void *new_mem = backend_reserve_memory(size);
+	if(new_mem != NULL)
+		free(mem);
+
+	return new_mem;
+}
+
 void backend_wad_unload_file(void *data)
 {
 	if(!heap_free(data)) {
@@ -7,3 +7,8 @@
 #define htobe32(x) (bswap_32(x))
 
 
+
+#define bswap_64(x) ((((uint64_t)bswap_32((uint32_t)(x))) << 32) | bswap_32((uint32_t)((x) >> 32)))
+
+#define htobe64(x) (bswap_64(x))
+#define be64toh(x) (bswap_64(x))
@@ -15,18 +15,34 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <sys/mman.h>
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
 
 #include "endian_compat.h"
+#include "align.h"
 #include "backend.h"
 #include "minmax.h"
+#include "graphics.h"
+#include "heap.h"
 #include "iff-font.h"
 #include "wad.h"
+#include "wadcache.h"
 #include "choreography.h"
 #include "choreography_commands.h"
 #include "sound.h"
+#include "pcgrandom.h"
+#include "pacer.h"
+
+#ifdef BACKEND_SUPPORTS_PREFETCH
+#include "prefetch.h"
+#endif
+#ifdef BACKEND_SUPPORTS_MANIFEST
+#include "manifest.h"
+#endif
+#include "posix_sdl2_backend.h"
 
 SDL_Window *window;
 SDL_Renderer *renderer;
@@ -35,6 +51,10 @@ int window_width, window_height;
 void(*copper_func)(int x, int y, uint32_t *palette);
 
 uint8_t *wad; // the entire wad
+static uint8_t *choreography_data; // decompressed if need be
+static size_t choreography_size;
+static size_t wad_size;
+static bool wad_mapped; // else read into memory
 
 // Set this to > 1 to slow down time in the choreographer.
 #define GLOBAL_SLOWDOWN 1
@@ -43,6 +63,9 @@ uint8_t *wad; // the entire wad
  * which run at 25 fps */
 #define MS_PER_FRAME 20
 
+// How far the left and right cursor keys seek.
+#define SEEK_STEP_MS 5000
+
 /* Current palette -- we pretranslate EHB mode */
 uint32_t palette[64];
 
@@ -52,46 +75,111 @@ uint32_t *framebuffer;
 uint8_t *bitplane_pool_start, *bitplane_pool_next, *bitplane_pool_end;
 struct Bitplane backend_bitplane[6];
 
+/* Planes are packed into the pool so that they don't fight over cache sets:
+ * each starts on a cache line, at a different offset within the span of
+ * addresses which map to distinct sets. Otherwise screen-sized planes, which
+ * are often a multiple of 4K, all land on the same sets and c2p thrashes. */
+#define POOL_CACHE_LINE 64
+#define POOL_SET_SPAN 4096
+#define POOL_PLANE_STAGGER ((POOL_SET_SPAN / 6) & ~(POOL_CACHE_LINE - 1))
+#define POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
 // Set to -1 if no font loaded. If >= 0 a font
 // is loaded and the bitplanes are valid.
 int loaded_font_idx; 
 // Bespoke artisanal bitplanes just for the font.
 struct Bitplane font_bitplane[6];
 
-uint64_t backend_get_time_ms()
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+static int pending_seek_ms; // requested by the cursor keys, done at the start of the next frame
+#endif
+
+// Deterministic playback, see posix_backend_set_playback()
+static int fixed_step_ms;
+static int max_frames;
+static int virtual_ms;
+static unsigned frames_rendered;
+
+// A/V sync, see posix_backend_set_audio_clock()
+#ifndef AUDIO_SLEW_DIVISOR
+#define AUDIO_SLEW_DIVISOR 8 // following the audio, take up this fraction of the skew each frame...
+#endif
+#ifndef AUDIO_RESYNC_MS
+#define AUDIO_RESYNC_MS 500 // ...unless it's further out than this
+#endif
+static bool audio_clock;
+static int audio_offset_ms; // seeks move the demo but not the music
+static unsigned skew_count;
+static int64_t skew_total;
+static int skew_worst;
+
+// Unattended playback, see posix_backend_set_loop()
+static bool loop;
+static int loop_start_ms;
+static unsigned loop_iteration;
+static unsigned loop_frames;
+static uint64_t loop_start_ns, loop_draw_ns, loop_worst_draw_ns;
+
+// Memory use, for checking that looping doesn't leak
+static size_t reserved_bytes;
+static size_t pool_peak;
+
+// The PCG reference initialiser, so runs are repeatable even without a seed.
+static pcg32_random_t rng = {0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL};
+
+void posix_backend_set_playback(int fixed_step_ms_in, int max_frames_in)
 {
-#ifdef NO_POSIX_REALTIME_CLOCKS
-	struct timeval tv;
+	fixed_step_ms = fixed_step_ms_in;
+	max_frames = max_frames_in;
+}
 
-	gettimeofday(&tv, NULL);
+void posix_backend_set_audio_clock(bool enabled)
+{
+	audio_clock = enabled;
+}
 
-	uint64_t time = (uint64_t)(tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-#else
-	struct timespec tp;
+void posix_backend_set_loop(bool enabled)
+{
+	loop = enabled;
+}
 
-	clock_gettime(CLOCK_REALTIME, &tp);
-	
-	uint64_t time = (uint64_t)(tp.tv_sec * 1000) + (tp.tv_nsec / 1000000);
-#endif
+void posix_backend_seed_random(uint64_t seed)
+{
+	pcg32_srandom_r(&rng, seed, 0);
+}
 
-	return time / GLOBAL_SLOWDOWN;
+uint64_t backend_get_time_ms()
+{
+	return pacer_now_ns() / (NS_PER_MS * GLOBAL_SLOWDOWN);
 }
 
 
 bool backend_should_display_next_frame(int64_t time_remaining_this_frame)
 {
-	if(time_remaining_this_frame > 0) {
-		SDL_Event event;
-		if(SDL_WaitEventTimeout(&event, time_remaining_this_frame) != 0) {
-			switch(event.type) {
-				case SDL_KEYDOWN:
-					if(event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)
-						return false;
-					break;
-			}
+	SDL_Event event;
+
+	while(SDL_PollEvent(&event)) {
+		switch(event.type) {
+			case SDL_KEYDOWN:
+				if(event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)
+					return false;
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+				if(event.key.keysym.scancode == SDL_SCANCODE_LEFT)
+					pending_seek_ms -= SEEK_STEP_MS;
+				if(event.key.keysym.scancode == SDL_SCANCODE_RIGHT)
+					pending_seek_ms += SEEK_STEP_MS;
+#endif
+				break;
 		}
 	}
 
+	if(max_frames && frames_rendered >= max_frames)
+		return false;
+
+	// With vsync, presenting the frame has already done the waiting.
+	if(time_remaining_this_frame > 0)
+		pacer_sleep_until(pacer_next_frame_ns());
+
 	return true;
 }
 
@@ -168,6 +256,32 @@ void backend_render_32bits()
 	SDL_RenderPresent(renderer);
 }
 
+/* Range of rows which may have pixels set in any plane. Scrolled planes, or
+ * planes not the size of the window, may show anything on any row. */
+static void drawn_rows(int *first, int *last)
+{
+	*first = window_height;
+	*last = -1;
+
+	for(int i = 0; i < 6; i++) {
+		struct Bitplane *plane = &backend_bitplane[i];
+
+		if(plane->data == NULL)
+			continue;
+
+		if(plane->data != plane->data_start || plane->height != window_height) {
+			*first = 0;
+			*last = window_height - 1;
+			return;
+		}
+
+		if(plane->drawn.x1 >= plane->drawn.x0) {
+			*first = min(*first, plane->drawn.y0);
+			*last = max(*last, plane->drawn.y1);
+		}
+	}
+}
+
 void backend_render()
 {
 	//SDL_RenderPresent(renderer);
@@ -181,10 +295,19 @@ void backend_render()
 	int fb_idx = 0;
 	int copper_check_step = window_width / 40;
 
+	// Rows outside this range are colour 0 throughout, unless the copper is changing it.
+	int first_drawn_row, last_drawn_row;
+	drawn_rows(&first_drawn_row, &last_drawn_row);
+
 	for(int y = 0; y < window_height; y++) {
 		int bitx = 0, x = 0;
 		int next_copper_check_location = 0;
 
+		if(copper_func == NULL && (y < first_drawn_row || y > last_drawn_row)) {
+			for(; x < window_width; x++)
+				framebuffer[fb_idx + x] = palette[0];
+		}
+
 		while(x < window_width) {
 			if(copper_func && x >= next_copper_check_location) {
 				copper_func(x * 40 / window_width, y * 256 / window_height, palette);
@@ -234,6 +357,107 @@ void backend_register_copper_func(void(*func)(int x, int y, uint32_t *palette))
 	copper_func = func;
 }
 
+/* Rows a multiple of the set span apart share cache sets, which hurts
+ * anything walking down a plane, so avoid such strides. */
+static int pool_stride(int width)
+{
+	int stride = align(width / 8, sizeof(uint32_t));
+
+	if(stride % (POOL_SET_SPAN / 16) == 0)
+		stride += POOL_CACHE_LINE;
+
+	return stride;
+}
+
+/* Pool needed for a plane, including the worst case for placing its start. */
+static size_t pool_plane_bytes(int width, int height)
+{
+	return (size_t)pool_stride(width) * height + POOL_SET_SPAN;
+}
+
+#ifdef BACKEND_SUPPORTS_MANIFEST
+/* Pool needed for a scene's planes: styles are BITPLANE_* in choreography.c. */
+static size_t pool_scene_bytes(const struct manifest_scene *scene)
+{
+	size_t bytes = 0;
+
+	for(int i = 0; i < 6; i++) {
+		switch(scene->bitplane_style[i]) {
+			case 1: bytes += pool_plane_bytes(window_width, window_height); break;
+			case 2: bytes += pool_plane_bytes(window_width * 2, window_height); break;
+			case 3: bytes += pool_plane_bytes(window_width * 2, window_height * 2); break;
+		}
+	}
+
+	return bytes;
+}
+#endif
+
+/* Allocate the pool, cache-line aligned. Large pools are rounded up to whole
+ * huge pages, and *size updated, so the kernel can back them with those. */
+static uint8_t *pool_alloc(size_t *size)
+{
+	size_t alignment = POOL_CACHE_LINE;
+	void *pool;
+
+#ifdef MADV_HUGEPAGE
+	if(*size >= POOL_HUGEPAGE_SIZE) {
+		alignment = POOL_HUGEPAGE_SIZE;
+		*size = (*size + POOL_HUGEPAGE_SIZE - 1) & ~(size_t)(POOL_HUGEPAGE_SIZE - 1);
+	}
+#endif
+
+	if(posix_memalign(&pool, alignment, *size) != 0)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	if(alignment == POOL_HUGEPAGE_SIZE)
+		madvise(pool, *size, MADV_HUGEPAGE); // only a hint
+#endif
+
+	return pool;
+}
+
+#ifndef __EMSCRIPTEN__
+/* Map the wad rather than reading it, so startup doesn't wait for the whole
+ * file and its pages can be shared with other processes. Private and
+ * writable, in case anything patches the data in place. */
+static uint8_t *map_entire_wad(const char *filename) {
+	int h = open(filename, O_RDONLY);
+	if(h < 0)
+		return NULL;
+
+	struct stat statbuf;
+	if(fstat(h, &statbuf) != 0 || statbuf.st_size == 0) {
+		close(h);
+		return NULL;
+	}
+
+	void *buf = mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, h, 0);
+	close(h);
+
+	if(buf == MAP_FAILED)
+		return NULL;
+
+	wad_size = statbuf.st_size;
+	return buf;
+}
+#endif
+
+/* Ask for part of a mapped wad to be read in ahead of use. */
+static void wad_will_need(uint32_t offset, size_t size)
+{
+#ifdef MADV_WILLNEED
+	if(!wad_mapped || size == 0)
+		return;
+
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t start = offset - (offset % page_size);
+
+	madvise(wad + start, (offset - start) + size, MADV_WILLNEED); // only a hint
+#endif
+}
+
 static uint8_t *read_entire_wad(const char *filename) {
 	uint8_t *buf;
 	
@@ -285,12 +509,33 @@ void _dummy_main_loop()
 bool backend_init(int width, int height, bool fullscreen, const void *wad_name)
 {
 	/* Read WAD */
-	wad = read_entire_wad(wad_name ? (const char *)wad_name: "sota.wad");
+	const char *wad_filename = wad_name ? (const char *)wad_name: "sota.wad";
+#ifndef __EMSCRIPTEN__
+	wad = map_entire_wad(wad_filename);
+	wad_mapped = (wad != NULL);
+	if(wad == NULL)
+#endif
+		wad = read_entire_wad(wad_filename);
 	if(wad == NULL) {
 		fprintf(stderr, "Couldn't read wad\n");
 		return false;
 	}
 
+	if(!wad_check_header(wad)) {
+		fprintf(stderr, "%s isn't a wad this version can read; rebuild it\n", wad_filename);
+		return false;
+	}
+
+	// Needed straight away.
+	wad_will_need(wad_get_choreography_offset(wad), wad_get_choreography_size(wad));
+
+	// The choreography, like anything else loaded but never unloaded, stays in the cache.
+	if(!wadcache_init(wad)
+			|| (choreography_data = backend_wad_load_file(wad_get_choreography_file_idx(wad), &choreography_size)) == NULL) {
+		fprintf(stderr, "Couldn't load choreography\n");
+		return false;
+	}
+
 #ifdef __EMSCRIPTEN__
 	/* Dummy main loop early so we can call SDL functions (timers I think)
 	 * which trigger emscripten_set_main_loop_timing. */
@@ -325,12 +570,19 @@ bool backend_init(int width, int height, bool fullscreen, const void *wad_name)
 
 	SDL_GetWindowSize(window, &window_width, &window_height);
 
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	// Fixed-step playback runs as fast as it can, so don't wait for vsync.
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (fixed_step_ms ? 0 : SDL_RENDERER_PRESENTVSYNC));
 	if(renderer == NULL) {
 		fprintf(stderr, "SDL_CreateRenderer: %s\n", SDL_GetError());
 		return false;
 	}
 
+	SDL_RendererInfo renderer_info;
+	SDL_DisplayMode window_mode;
+	bool vsync = SDL_GetRendererInfo(renderer, &renderer_info) == 0 && (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC);
+	int refresh_hz = SDL_GetWindowDisplayMode(window, &window_mode) == 0 ? window_mode.refresh_rate : 0;
+	pacer_init(vsync, refresh_hz, MS_PER_FRAME * GLOBAL_SLOWDOWN * NS_PER_MS);
+
 	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, window_width, window_height);
 	if(texture == NULL) {
 		fprintf(stderr, "SDL_CreateTexture: %s\n", SDL_GetError());
@@ -346,8 +598,19 @@ bool backend_init(int width, int height, bool fullscreen, const void *wad_name)
 	SDL_RenderPresent(renderer);
 
 	// reserve memory for a pool of bitplane allocations equal to 10 windows' worth of data
-	size_t bitmap_amt = (window_width / 8) * window_height * 10;
-	bitplane_pool_start = bitplane_pool_next = malloc(bitmap_amt);
+	size_t bitmap_amt = pool_plane_bytes(window_width, window_height) * 10;
+#ifdef BACKEND_SUPPORTS_MANIFEST
+	// ... unless the WAD says exactly how much the biggest scene needs.
+	int manifest_idx = wad_get_manifest_file_idx(wad);
+	size_t manifest_size;
+	void *manifest_data = manifest_idx >= 0 ? backend_wad_load_file(manifest_idx, &manifest_size) : NULL;
+	if(manifest_data && manifest_init(manifest_data, manifest_size)) {
+		bitmap_amt = pool_plane_bytes(window_width, window_height) * 6; // the standard planes
+		for(int i = 0; i < manifest_num_scenes(); i++)
+			bitmap_amt = max(bitmap_amt, pool_scene_bytes(manifest_get_scene(i)));
+	}
+#endif
+	bitplane_pool_start = bitplane_pool_next = pool_alloc(&bitmap_amt);
 	if(bitplane_pool_start == NULL) {
 		fprintf(stderr, "couldn't allocate bitplane memory\n");
 		return false;
@@ -361,6 +624,11 @@ bool backend_init(int width, int height, bool fullscreen, const void *wad_name)
 	// Initially the font bitplanes are null.
 	loaded_font_idx = -1;
 
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	// Not fatal: without the worker everything is prepared when it's needed.
+	prefetch_init();
+#endif
+
 	return true;
 }
 
@@ -368,21 +636,29 @@ struct Bitplane *backend_allocate_bitplane(int idx, int width, int height)
 {
 	assert(backend_bitplane[idx].data_start == NULL);
 
-	int stride = width / 8;
+	int stride = pool_stride(width);
+
+	// Start on a cache line, staggered by plane number.
+	size_t offset = align(bitplane_pool_next - bitplane_pool_start, POOL_CACHE_LINE);
+	offset += ((idx * POOL_PLANE_STAGGER) - (offset % POOL_SET_SPAN) + POOL_SET_SPAN) % POOL_SET_SPAN;
 
-	backend_bitplane[idx].data_start = backend_bitplane[idx].data = bitplane_pool_next;
-	bitplane_pool_next += (height * stride);
+	backend_bitplane[idx].data_start = backend_bitplane[idx].data = bitplane_pool_start + offset;
+	bitplane_pool_next = bitplane_pool_start + offset + (height * stride);
 	
 	if(bitplane_pool_next > bitplane_pool_end) {
 		fprintf(stderr, "Bitplane alloc overflow\n");
 		abort();
 	}
+	pool_peak = max(pool_peak, (size_t)(bitplane_pool_next - bitplane_pool_start));
 
 	backend_bitplane[idx].idx = idx;
 	backend_bitplane[idx].width = width;
 	backend_bitplane[idx].height = height;
 	backend_bitplane[idx].stride = stride;
 
+	// Pool memory isn't cleared, so assume the whole plane is dirty.
+	planar_extent_full(&backend_bitplane[idx]);
+
 	return &backend_bitplane[idx];
 }
 
@@ -394,6 +670,20 @@ void backend_allocate_standard_bitplanes() {
 	}
 }
 
+#ifdef BACKEND_SUPPORTS_MANIFEST
+bool backend_bitplanes_fit(const int width[6], const int height[6])
+{
+	size_t bytes = 0;
+
+	for(int i = 0; i < 6; i++) {
+		if(width[i] && height[i])
+			bytes += pool_plane_bytes(width[i], height[i]);
+	}
+
+	return bytes <= (size_t)(bitplane_pool_end - bitplane_pool_start);
+}
+#endif
+
 void backend_set_new_scene() {
 	for(int i = 0; i < 6; i++) {
 		backend_bitplane[i].data_start = backend_bitplane[i].data = NULL;
@@ -403,11 +693,44 @@ void backend_set_new_scene() {
 	bitplane_pool_next = bitplane_pool_start;
 }
 
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+/* The pool never moves, so plane pointers can be saved as they are. */
+struct backend_snapshot {
+	struct Bitplane planes[6];
+	size_t pool_used;
+	uint8_t pool[];
+};
+
+size_t backend_snapshot_size(void)
+{
+	return sizeof(struct backend_snapshot) + (bitplane_pool_next - bitplane_pool_start);
+}
+
+void backend_snapshot_save(void *dest)
+{
+	struct backend_snapshot *snap = dest;
+
+	memcpy(snap->planes, backend_bitplane, sizeof(snap->planes));
+	snap->pool_used = bitplane_pool_next - bitplane_pool_start;
+	memcpy(snap->pool, bitplane_pool_start, snap->pool_used);
+}
+
+void backend_snapshot_restore(const void *src)
+{
+	const struct backend_snapshot *snap = src;
+
+	memcpy(backend_bitplane, snap->planes, sizeof(backend_bitplane));
+	bitplane_pool_next = bitplane_pool_start + snap->pool_used;
+	memcpy(bitplane_pool_start, snap->pool, snap->pool_used);
+}
+#endif
+
 void backend_copy_bitplane(struct Bitplane *dst, struct Bitplane *src)
 {
 	assert(dst->height == src->height && dst->stride == src->stride);
 
 	memcpy(dst->data_start, src->data_start, src->stride * src->height);
+	dst->drawn = src->drawn;
 }
 
 void *backend_reserve_memory(size_t amt)
@@ -417,13 +740,44 @@ void *backend_reserve_memory(size_t amt)
 		perror("malloc");
 		abort();
 	}
+	reserved_bytes += amt;
 
 	return mem;
 }
 
+/* Unlike backend_reserve_memory, failure isn't fatal: the caller keeps the
+ * old block and copes. */
+void *backend_resize_reserved_memory(void *mem, size_t old_size, size_t amt)
+{
+	void *new_mem = malloc(amt);
+	if(new_mem == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+
+	free(mem);
+	reserved_bytes += amt - old_size;
+
+	return new_mem;
+}
+
 void backend_shutdown()
 {
-	free(wad);
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	prefetch_shutdown();
+#endif
+
+	// scene choreographies point into this, so it's held until now
+	backend_wad_unload_file(choreography_data);
+	choreography_data = NULL;
+
+#ifndef __EMSCRIPTEN__
+	if(wad_mapped)
+		munmap(wad, wad_size);
+	else
+#endif
+		free(wad);
+	wadcache_shutdown();
 	free(framebuffer);
 
 	SDL_DestroyRenderer(renderer);
@@ -437,23 +791,19 @@ void backend_get_palette(int num_elements, uint32_t *elements) {
 	memcpy(elements, palette, num_elements * sizeof(uint32_t));
 }
 
+/* Only entries which actually changed get their EHB mirror recomputed. */
 void backend_set_palette(int num_elements, uint32_t *elements) {
-	memcpy(palette, elements, num_elements * sizeof(uint32_t));
-	for(int i = num_elements; i < 32; i++) {
-		palette[i] = 0xff000000;
-	}
-
 	for(int i = 0; i < 32; i++) {
-		uint32_t double_bright = palette[i];
-		palette[i + 32] = 0xff000000
-			| (((double_bright & 0x00ff0000) >> 17) << 16)
-			| (((double_bright & 0x0000ff00) >> 9) << 8)
-			| (((double_bright & 0x000000ff) >> 1));
+		uint32_t colour = i < num_elements ? elements[i] : 0xff000000;
+		if(palette[i] != colour)
+			backend_set_palette_element(i, colour);
 	}
 }
 
 void backend_set_palette_element(int idx, uint32_t element) {
 	palette[idx] = element;
+	if(idx < 32)
+		palette[idx + 32] = 0xff000000 | ((element >> 1) & 0x007f7f7f);
 }
 
 uint32_t backend_get_palette_element(int idx)
@@ -472,6 +822,18 @@ bool backend_font_load(int file_idx, uint32_t startchar, uint32_t numchars, uint
 		backend_font_unload();
 	}
 
+	bool result;
+
+#ifdef BACKEND_SUPPORTS_PREFETCH
+	if(prefetch_take_font(file_idx, backend_bitplane[0].width, backend_bitplane[0].height, font_bitplane)) {
+		result = ifffont_load_prerendered(file_idx, startchar, numchars, positions, font_bitplane);
+		if(result)
+			loaded_font_idx = file_idx;
+
+		return result;
+	}
+#endif
+
 	for(int i = 0; i < 6; i++) {
 		font_bitplane[i].width = backend_bitplane[0].width;
 		font_bitplane[i].height = backend_bitplane[0].height;
@@ -485,7 +847,7 @@ bool backend_font_load(int file_idx, uint32_t startchar, uint32_t numchars, uint
 		}
 	}
 
-	bool result = ifffont_load(file_idx, startchar, numchars,
+	result = ifffont_load(file_idx, startchar, numchars,
 			positions, font_bitplane);
 
 	if(result) {
@@ -527,16 +889,28 @@ int backend_font_get_height()
 	return ifffont_get_height();
 }
 
-void *backend_wad_load_choreography_for_scene_ms(int ms)
+void *backend_wad_load_choreography_for_scene_ms(int ms, size_t *size_out)
 {
-	uint8_t *choreography = wad + wad_get_choreography_offset(wad);
+	uint32_t scene_offset = choreography_find_offset_for_scene(choreography_data, ms, NULL);
+
+	// The rest of the choreography is available, not just this scene.
+	if(size_out != NULL)
+		*size_out = choreography_size - scene_offset;
 
-	return choreography + choreography_find_offset_for_scene(choreography, ms, NULL);
+	return choreography_data + scene_offset;
+}
+
+int backend_wad_get_file_count(void)
+{
+	return wad_get_file_count(wad);
 }
 
 /* Load a file */
 void *backend_wad_load_file(int file_idx, size_t *size_out)
 {
+	if(wad_file_is_compressed(wad, file_idx))
+		return wadcache_load(file_idx, size_out);
+
 	// in this backend the entire wad is mapped so no copying or loading required.
 	uint32_t offset = wad_get_file_offset(wad, file_idx);
 
@@ -549,32 +923,152 @@ void *backend_wad_load_file(int file_idx, size_t *size_out)
 
 void backend_wad_unload_file(void *data)
 {
-	/* wad is permanently loaded */
+	/* wad is permanently loaded, but decompressed files are cached */
+	wadcache_unload(data);
 }
 
-static uint32_t scene_name_to_scene_ms(char *scene_name)
+#ifdef BACKEND_SUPPORTS_MANIFEST
+void backend_wad_will_need_file(int file_idx)
 {
-	uint8_t *choreography = wad + wad_get_choreography_offset(wad);
+	wad_will_need(wad_get_file_offset(wad, file_idx), wad_get_file_size(wad, file_idx));
+}
+#endif
 
-	return choreography_find_ms_for_scene_name(choreography, scene_name);
+static uint32_t scene_name_to_scene_ms(char *scene_name)
+{
+	return choreography_find_ms_for_scene_name(choreography_data, scene_name);
 }
 
-static uint64_t starttime;
+static uint64_t start_ns; // when demo ms 0 was (or would have been) shown
+static int set_ms; // the demo time last given to set_demo_ms()
 static int64_t time_remaining_this_frame;
 
+static int ns_to_demo_ms(uint64_t ns)
+{
+	return (ns - start_ns) / (NS_PER_MS * GLOBAL_SLOWDOWN);
+}
+
+static void set_demo_ms(uint64_t ns, int ms)
+{
+	start_ns = ns - ((uint64_t)ms * NS_PER_MS * GLOBAL_SLOWDOWN);
+	set_ms = ms;
+}
+
+/* Compare the clock with what can be heard, and follow the audio if asked.
+ * Returns the demo time to draw for a frame shown at present_ns. */
+static int sync_to_audio(uint64_t present_ns, int ms)
+{
+	int audio_ms;
+
+	if(!sound_get_demo_ms(&audio_ms))
+		return ms;
+
+	// The audio position is for now; the frame will be seen a little later.
+	audio_ms += audio_offset_ms + ns_to_demo_ms(present_ns) - ns_to_demo_ms(pacer_now_ns());
+
+	int skew = audio_ms - ms;
+	skew_count++;
+	skew_total += skew;
+	if(abs(skew) > abs(skew_worst))
+		skew_worst = skew;
+
+	if(audio_clock) {
+		/* The audio position moves in steps (a player tick, or a buffer),
+		 * so steer the clock towards it rather than jumping, and never
+		 * let the demo go backwards. */
+		int correction = abs(skew) > AUDIO_RESYNC_MS ? skew : skew / AUDIO_SLEW_DIVISOR;
+
+		ms = max(set_ms, max(0, ms + correction));
+		set_demo_ms(present_ns, ms);
+	}
+
+	return ms;
+}
+
+/* One line per time round, to show that nothing leaks and nothing slows
+ * down once the caches are warm. */
+static void loop_report(uint64_t now_ns)
+{
+	backend_debug("loop %u: %u frames in %u ms, drawing %.2f ms mean, %.2f ms worst; "
+			"heap %zu free, pool peak %zu, reserved %zu bytes",
+			loop_iteration, loop_frames, (unsigned int)((now_ns - loop_start_ns) / NS_PER_MS),
+			loop_frames ? (double)loop_draw_ns / loop_frames / NS_PER_MS : 0.0,
+			(double)loop_worst_draw_ns / NS_PER_MS,
+			heap_avail(), pool_peak, reserved_bytes);
+
+	loop_iteration++;
+	loop_frames = 0;
+	loop_start_ns = now_ns;
+	loop_draw_ns = loop_worst_draw_ns = 0;
+}
+
 void _backend_run_one()
 {
 	int ms;
 
-	uint64_t frametime = backend_get_time_ms();
-	ms = frametime - starttime;
+	/* Draw the frame as of when it will be on screen, not when we start it. */
+	uint64_t present_ns = pacer_frame_start();
+	heap_frame_reset();
+	ms = fixed_step_ms ? virtual_ms : sync_to_audio(present_ns, ns_to_demo_ms(present_ns));
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+	if(pending_seek_ms) {
+		int seek_ms = max(0, ms + pending_seek_ms);
+		pending_seek_ms = 0;
 
+		audio_offset_ms += seek_ms - ms;
+		ms = seek_ms;
+		choreography_seek(ms);
+		set_demo_ms(present_ns, ms);
+	}
+#endif
+
+	if(loop && choreography_finished(ms)) {
+		loop_report(pacer_now_ns());
+		audio_offset_ms = 0;
+		ms = loop_start_ms;
+		choreography_restart(ms);
+		set_demo_ms(present_ns, ms);
+	}
+
+	uint64_t draw_start_ns = pacer_now_ns();
 	choreography_do_frame(ms);
 
-	time_remaining_this_frame = (MS_PER_FRAME * GLOBAL_SLOWDOWN) - (backend_get_time_ms() - frametime);
+	uint64_t draw_ns = pacer_now_ns() - draw_start_ns;
+	loop_draw_ns += draw_ns;
+	loop_worst_draw_ns = max(loop_worst_draw_ns, draw_ns);
+	loop_frames++;
 
 	backend_render();
+
+	if(fixed_step_ms) {
+		virtual_ms = ms + fixed_step_ms;
+		time_remaining_this_frame = 0;
+	} else {
+		pacer_frame_presented();
+		uint64_t next_ns = pacer_next_frame_ns();
+		uint64_t now_ns = pacer_now_ns();
+		time_remaining_this_frame = next_ns > now_ns ? next_ns - now_ns : 0;
+	}
+
 	sound_update();
+	frames_rendered++;
+}
+
+static void print_timing_summary(uint64_t run_start_time, int start_ms)
+{
+	uint64_t elapsed = backend_get_time_ms() - run_start_time;
+	int demo_ms = (fixed_step_ms ? virtual_ms : ns_to_demo_ms(pacer_now_ns())) - start_ms;
+
+	backend_debug("%u frames, %d ms of demo in %u ms (%.2f ms per frame)",
+			frames_rendered, demo_ms, (unsigned int)elapsed,
+			frames_rendered ? (double)elapsed / frames_rendered : 0.0);
+	if(!fixed_step_ms)
+		pacer_report();
+	if(skew_count)
+		backend_debug("A/V skew (audio - video): mean %d ms, worst %d ms over %u frames%s",
+				(int)(skew_total / skew_count), skew_worst, skew_count,
+				audio_clock ? ", following the audio clock" : "");
 }
 
 void backend_run(int ms, char *scene_name)
@@ -583,13 +1077,16 @@ void backend_run(int ms, char *scene_name)
 		ms = scene_name_to_scene_ms(scene_name);
 	}
 
-	starttime = backend_get_time_ms();
+	uint64_t run_start_time = backend_get_time_ms();
+	virtual_ms = loop_start_ms = ms;
+	loop_start_ns = pacer_now_ns();
 
-	/* If 'ms' is initially >0, backdate startime */
-	starttime -= ms;
+	/* If 'ms' is initially >0, backdate the start */
+	set_demo_ms(pacer_now_ns(), ms);
 
-	uint8_t *choreography = backend_wad_load_choreography_for_scene_ms(ms);
-	if(!choreography_prepare_to_run(choreography, ms))
+	size_t choreography_size;
+	uint8_t *choreography = backend_wad_load_choreography_for_scene_ms(ms, &choreography_size);
+	if(!choreography_prepare_to_run(choreography, choreography_size, ms))
 		return;
 
 #ifdef __EMSCRIPTEN__
@@ -603,7 +1100,7 @@ void backend_run(int ms, char *scene_name)
 		keepgoing = backend_should_display_next_frame(time_remaining_this_frame);
 	}
 
-	backend_wad_unload_file(choreography);
+	print_timing_summary(run_start_time, ms);
 #endif
 }
 
@@ -620,6 +1117,6 @@ void backend_debug(const char *fmt, ...)
 
 int backend_random()
 {
-	return rand();
+	return pcg32_random_r(&rng) >> 1;
 }
 
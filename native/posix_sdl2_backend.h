@@ -2,3 +2,15 @@
 
 struct backend_interface_struct *get_posix_backend();
 
+/* Deterministic playback: advance fixed_step_ms of demo time per frame rather
+ * than following the clock (0 for real time), and stop after max_frames
+ * frames (0 for no limit). Call before backend_init. */
+void posix_backend_set_playback(int fixed_step_ms, int max_frames);
+void posix_backend_seed_random(uint64_t seed);
+/* Drive the demo from the music's playback position rather than the clock.
+ * A/V skew is measured and reported either way. */
+void posix_backend_set_audio_clock(bool enabled);
+/* Go back to the start rather than stopping at the end of the demo, keeping
+ * everything loaded, and report timing and memory use each time round. */
+void posix_backend_set_loop(bool enabled);
+
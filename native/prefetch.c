@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tinf/src/tinf.h"
+
+#include "backend.h"
+#include "graphics.h"
+#include "palette.h"
+#include "iff.h"
+#include "iff-font.h"
+#include "mbit.h"
+#include "minmax.h"
+#include "prefetch.h"
+
+// Jobs which can be queued or finished at once. Each may hold a few screens of planes.
+#ifndef PREFETCH_SLOTS
+#define PREFETCH_SLOTS 4
+#endif
+
+enum job {
+	JOB_ILBM,
+	JOB_MBIT,
+	JOB_FONT
+};
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_QUEUED,
+	SLOT_WORKING, // owned by the worker, apart from 'discard' and 'scan'
+	SLOT_READY    // owned by the main thread
+};
+
+struct slot {
+	enum slot_state state;
+	enum job job;
+	const void *key; // the command, or NULL for fonts
+	int font_file; // for fonts, which
+	unsigned seq; // queue order
+	unsigned scan; // last lookahead pass which asked for this
+	bool discard; // wanted by the time it's done? (set if the command ran early)
+
+	// What to make
+	int file_idx;
+	int width, height;
+	int x, y, w, h, start_plane;
+
+	// What was made
+	struct Bitplane planes[6];
+	int plane_mask;
+	uint32_t num_colours;
+	uint32_t palette[PALETTE_SIZE];
+	void *data; // mbit source
+	uint8_t *decoded;
+};
+
+static struct slot slots[PREFETCH_SLOTS];
+static unsigned next_seq, current_scan;
+
+static pthread_t worker_thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static bool running, quit;
+
+static bool alloc_planes(struct slot *slot, int mask)
+{
+	for(int i = 0; i < 6; i++) {
+		if(mask & (1 << i)) {
+			struct Bitplane *plane = &slot->planes[i];
+
+			plane->idx = i;
+			plane->width = slot->width;
+			plane->height = slot->height;
+			plane->stride = slot->width / 8;
+			plane->data = plane->data_start = calloc(plane->height, plane->stride);
+			if(plane->data == NULL)
+				return false;
+
+			planar_extent_empty(plane);
+		}
+	}
+
+	slot->plane_mask = mask;
+	return true;
+}
+
+static void free_result(struct slot *slot)
+{
+	for(int i = 0; i < 6; i++) {
+		free(slot->planes[i].data_start);
+	}
+	memset(slot->planes, 0, sizeof(slot->planes));
+	slot->plane_mask = 0;
+
+	free(slot->decoded);
+	slot->decoded = NULL;
+
+	if(slot->data) {
+		backend_wad_unload_file(slot->data);
+		slot->data = NULL;
+	}
+}
+
+static bool do_ilbm(struct slot *slot)
+{
+	struct LoadedIff iff;
+
+	if(!iff_load(slot->file_idx, &iff))
+		return false;
+
+	int nplanes = min(iff.bmhd->nPlanes, 5);
+	bool ok = slot->start_plane + nplanes <= 6 && iff.cmap_count <= PALETTE_SIZE
+		&& alloc_planes(slot, ((1 << nplanes) - 1) << slot->start_plane);
+
+	if(ok) {
+		// the frame arena belongs to the main thread
+		int8_t *scratch = malloc(iff_scratch_size(&iff));
+		ok = iff_display(&iff, slot->x, slot->y, slot->w, slot->h, &slot->num_colours, slot->palette, slot->planes, slot->start_plane, scratch);
+		free(scratch);
+	}
+
+	iff_unload(&iff);
+	return ok;
+}
+
+static bool do_mbit(struct slot *slot)
+{
+	slot->data = backend_wad_load_file(slot->file_idx, NULL);
+	if(slot->data == NULL)
+		return false;
+
+	slot->decoded = malloc(mbit_decoded_size(slot->data));
+	void *tinf_data = malloc(tinf_data_size());
+
+	bool ok = slot->decoded && tinf_data && mbit_decode(slot->data, slot->decoded, tinf_data);
+
+	free(tinf_data);
+	return ok;
+}
+
+static bool do_font(struct slot *slot)
+{
+	struct LoadedIff iff;
+	uint16_t w, h;
+
+	if(!iff_load(slot->file_idx, &iff))
+		return false;
+
+	bool ok = alloc_planes(slot, 0x3f);
+	if(ok) {
+		int scale = ifffont_scale_for(&iff, slot->width, slot->height);
+
+		int8_t *scratch = malloc(iff_scratch_size(&iff));
+
+		iff_get_dimensions(&iff, &w, &h);
+		ok = iff_display(&iff, 0, 0, w * scale, h * scale, NULL, NULL, slot->planes, 0, scratch);
+		free(scratch);
+	}
+
+	iff_unload(&iff);
+	return ok;
+}
+
+static bool do_job(struct slot *slot)
+{
+	switch(slot->job) {
+		case JOB_ILBM:
+			return do_ilbm(slot);
+		case JOB_MBIT:
+			return do_mbit(slot);
+		case JOB_FONT:
+			return do_font(slot);
+	}
+
+	return false;
+}
+
+// Call with the lock held.
+static struct slot *next_queued(void)
+{
+	struct slot *next = NULL;
+
+	for(int i = 0; i < PREFETCH_SLOTS; i++) {
+		if(slots[i].state == SLOT_QUEUED && (next == NULL || slots[i].seq < next->seq))
+			next = &slots[i];
+	}
+
+	return next;
+}
+
+static void *worker(void *arg)
+{
+	pthread_mutex_lock(&lock);
+
+	while(!quit) {
+		struct slot *slot = next_queued();
+		if(slot == NULL) {
+			pthread_cond_wait(&wake, &lock);
+			continue;
+		}
+
+		slot->state = SLOT_WORKING;
+		pthread_mutex_unlock(&lock);
+
+		bool ok = do_job(slot);
+
+		pthread_mutex_lock(&lock);
+		if(ok && !slot->discard) {
+			slot->state = SLOT_READY;
+		} else {
+			free_result(slot);
+			slot->state = SLOT_FREE;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+bool prefetch_init(void)
+{
+	quit = false;
+	running = pthread_create(&worker_thread, NULL, worker, NULL) == 0;
+	if(!running)
+		backend_debug("prefetch: couldn't start worker, preparing everything in time");
+
+	return running;
+}
+
+void prefetch_shutdown(void)
+{
+	if(running) {
+		pthread_mutex_lock(&lock);
+		quit = true;
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+
+		pthread_join(worker_thread, NULL);
+		running = false;
+	}
+
+	for(int i = 0; i < PREFETCH_SLOTS; i++) {
+		free_result(&slots[i]);
+		slots[i].state = SLOT_FREE;
+	}
+}
+
+void prefetch_begin_scan(void)
+{
+	current_scan++;
+}
+
+// Call with the lock held.
+static struct slot *find(enum job job, const void *key, int font_file)
+{
+	for(int i = 0; i < PREFETCH_SLOTS; i++) {
+		struct slot *slot = &slots[i];
+
+		if(slot->state != SLOT_FREE && !slot->discard && slot->job == job && slot->key == key && slot->font_file == font_file)
+			return slot;
+	}
+
+	return NULL;
+}
+
+/* Find or start a job. Returns a new slot, with the lock held, for the caller
+ * to fill in and queue(); or NULL if there's nothing to do. */
+static struct slot *request(enum job job, const void *key, int font_file, int width, int height)
+{
+	if(!running)
+		return NULL;
+
+	pthread_mutex_lock(&lock);
+
+	struct slot *slot = find(job, key, font_file);
+	if(slot) {
+		slot->scan = current_scan;
+		pthread_mutex_unlock(&lock);
+		return NULL;
+	}
+
+	// A free slot, or finished work which is no longer wanted
+	for(int i = 0; i < PREFETCH_SLOTS && slot == NULL; i++) {
+		if(slots[i].state == SLOT_FREE)
+			slot = &slots[i];
+	}
+	for(int i = 0; i < PREFETCH_SLOTS && slot == NULL; i++) {
+		if(slots[i].state == SLOT_READY && slots[i].scan != current_scan) {
+			slot = &slots[i];
+			free_result(slot);
+		}
+	}
+
+	if(slot == NULL) {
+		pthread_mutex_unlock(&lock);
+		return NULL;
+	}
+
+	slot->job = job;
+	slot->key = key;
+	slot->font_file = font_file;
+	slot->width = width;
+	slot->height = height;
+	slot->seq = next_seq++;
+	slot->scan = current_scan;
+	slot->discard = false;
+
+	return slot;
+}
+
+static void queue(struct slot *slot)
+{
+	slot->state = SLOT_QUEUED;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+}
+
+void prefetch_ilbm(const void *key, int file_idx, int width, int height, int x, int y, int w, int h, int start_plane)
+{
+	struct slot *slot = request(JOB_ILBM, key, -1, width, height);
+	if(slot) {
+		slot->file_idx = file_idx;
+		slot->x = x;
+		slot->y = y;
+		slot->w = w;
+		slot->h = h;
+		slot->start_plane = start_plane;
+		queue(slot);
+	}
+}
+
+void prefetch_mbit(const void *key, int file_idx)
+{
+	struct slot *slot = request(JOB_MBIT, key, -1, 0, 0);
+	if(slot) {
+		slot->file_idx = file_idx;
+		queue(slot);
+	}
+}
+
+void prefetch_font(int file_idx, int width, int height)
+{
+	struct slot *slot = request(JOB_FONT, NULL, file_idx, width, height);
+	if(slot) {
+		slot->file_idx = file_idx;
+		queue(slot);
+	}
+}
+
+/* Take finished work for the main thread, or forget it if it isn't ready or
+ * is the wrong size. */
+static struct slot *claim(enum job job, const void *key, int font_file, int width, int height)
+{
+	if(!running)
+		return NULL;
+
+	pthread_mutex_lock(&lock);
+
+	struct slot *slot = find(job, key, font_file);
+	if(slot) {
+		if(slot->state == SLOT_WORKING) {
+			slot->discard = true;
+			slot = NULL;
+		} else if(slot->state != SLOT_READY || slot->width != width || slot->height != height) {
+			free_result(slot);
+			slot->state = SLOT_FREE;
+			slot = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+	return slot;
+}
+
+/* Only the main thread touches READY slots, so the result can be freed
+ * unlocked, but the worker reads every slot's state. */
+static void release(struct slot *slot)
+{
+	free_result(slot);
+
+	pthread_mutex_lock(&lock);
+	slot->state = SLOT_FREE;
+	pthread_mutex_unlock(&lock);
+}
+
+bool prefetch_apply_ilbm(const void *key, struct Bitplane *planes, int start_plane, uint32_t *num_colours, uint32_t *palette_out)
+{
+	struct slot *slot = claim(JOB_ILBM, key, -1, planes[start_plane].width, planes[start_plane].height);
+	if(slot == NULL)
+		return false;
+
+	for(int i = 0; i < 6; i++) {
+		if((slot->plane_mask & (1 << i)) && (planes[i].width != slot->width || planes[i].height != slot->height)) {
+			release(slot);
+			return false;
+		}
+	}
+
+	graphics_blit(slot->planes, planes, slot->plane_mask, slot->x, slot->y, slot->w, slot->h, slot->x, slot->y);
+
+	*num_colours = slot->num_colours;
+	memcpy(palette_out, slot->palette, slot->num_colours * sizeof(uint32_t));
+
+	release(slot);
+	return true;
+}
+
+bool prefetch_apply_mbit(const void *key, struct Bitplane *planes)
+{
+	struct slot *slot = claim(JOB_MBIT, key, -1, 0, 0);
+	if(slot == NULL)
+		return false;
+
+	mbit_display_decoded(slot->data, slot->decoded, &palette_set, planes);
+
+	release(slot);
+	return true;
+}
+
+bool prefetch_take_font(int file_idx, int width, int height, struct Bitplane *planes)
+{
+	struct slot *slot = claim(JOB_FONT, NULL, file_idx, width, height);
+	if(slot == NULL)
+		return false;
+
+	memcpy(planes, slot->planes, sizeof(slot->planes));
+	memset(slot->planes, 0, sizeof(slot->planes));
+
+	release(slot);
+	return true;
+}
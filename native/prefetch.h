@@ -0,0 +1,43 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+/* Background preparation of upcoming choreography commands: decoding ILBMs
+ * and mbits, and rendering the font. A worker thread does the work into
+ * private staging planes and the main thread swaps the results in when the
+ * command runs -- or, if they aren't ready, the command does the work itself
+ * as usual.
+ *
+ * Work is keyed by the command which will use it (fonts by file), and is
+ * made for the plane size the command is expected to find.
+ *
+ * The worker only calls code which is safe off the main thread: iff_load()
+ * and iff_display() with scratch it malloc()s, backend_wad_load_file() and
+ * backend_wad_unload_file() (the wad cache is locked), and mbit_decode()
+ * with its own tinf data. It must not use the heap.c stack or frame arena,
+ * or read or set the palette; anything it needs from those is passed in or
+ * applied by the main thread. All functions below are main-thread only. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "backend.h"
+
+bool prefetch_init(void);
+void prefetch_shutdown(void);
+
+/* Call before each lookahead pass. Finished work which isn't asked for again
+ * during the pass may be discarded to make room. */
+void prefetch_begin_scan(void);
+
+void prefetch_ilbm(const void *key, int file_idx, int width, int height, int x, int y, int w, int h, int start_plane);
+void prefetch_mbit(const void *key, int file_idx);
+void prefetch_font(int file_idx, int width, int height);
+
+/* Apply finished work. These return false, and forget the work, if it
+ * isn't ready or was made for a different plane size. */
+bool prefetch_apply_ilbm(const void *key, struct Bitplane *planes, int start_plane, uint32_t *num_colours, uint32_t *palette_out);
+bool prefetch_apply_mbit(const void *key, struct Bitplane *planes);
+// Fills in all six planes with malloc()ed data, which the caller then owns.
+bool prefetch_take_font(int file_idx, int width, int height, struct Bitplane *planes);
+
+#endif // PREFETCH_H
@@ -7,15 +7,22 @@
 
 #include "heap.h"
 #include "graphics.h"
+#include "palette.h"
 #include "iff.h"
 #include "backend.h"
 #include "scene.h"
 #include "minmax.h"
 #include "pcgrandom.h"
+#include "align.h"
 
 #define VOTEVOTEVOTE_DISPLAY_MS 60
 //#define VOTEVOTEVOTE_DISPLAY_MS 5000
 
+// Most memory to use for pre-rendered words; 0 to always draw with the font.
+#ifndef VOTEVOTEVOTE_WORD_CACHE_KB
+#define VOTEVOTEVOTE_WORD_CACHE_KB 4096
+#endif
+
 #define COPPER_PASTELS_SWITCH_SPEED_MS 1600
 #define COPPER_PASTELS_WIDTH 16
 #define COPPER_PASTELS_HEIGHT 18
@@ -42,6 +49,16 @@ static int votevotevote_topline_count, votevotevote_midline_count, votevotevote_
 static int votevotevote_top, votevotevote_mid, votevotevote_bot; // the previous choice
 static uint32_t *votevotevote_palette_a, *votevotevote_palette_b;
 
+/* Every word of the text block, drawn into its own three planes when the
+ * effect starts. Words are centred, so only the y position changes. */
+struct votevotevote_word {
+	int x, y, width, height; // where the word was drawn when at y = 0
+	struct Bitplane planes[3];
+};
+static struct votevotevote_word *votevotevote_words; // NULL: draw with the font
+static uint8_t *votevotevote_word_memory;
+static size_t votevotevote_word_memory_size;
+
 int delayed_blit_next_blit = 0; // ms
 int delayed_blit_delay = 40; // ms
 
@@ -52,10 +69,10 @@ static struct copperpastels_effect_data_struct *g_copperpastels_effect_data;
 static int static_ticks_count;
 static pcg32_random_t static_rngstate;
 
-struct {
+struct votevotevote_text_block {
 	uint32_t block_length;
 	uint32_t num_entries;
-	uint16_t entries[];
+	uint16_t entries[]; // num_entries + 1 offsets from 'entries' to the text
 } *current_text_block;
 
 struct {
@@ -134,6 +151,109 @@ void scene_init()
 	global_scale = scale_x > scale_y? scale_x: scale_y;
 }
 
+/* The spotlight rings are concentric about the centre of the 2x2 plane, so
+ * they're symmetric about both axes. One quadrant is drawn, once per window
+ * size, and mirrored into the plane each time the effect starts. The
+ * quadrant has the centre at (0, 0) and goes one pixel past the window size,
+ * as the mirrored halves reach one pixel further from the centre. */
+static struct Bitplane rings_quadrant;
+static int rings_quadrant_window_width, rings_quadrant_window_height;
+static size_t rings_quadrant_size;
+
+static void draw_spotlight_rings(struct Bitplane *plane, int xc, int yc)
+{
+	/* Scale backgrounds sensibly */
+	int thickness = max(4 * global_scale, 4);
+	int gap = (2 * thickness) / 3;
+
+	int longest_distance = sqrt1(window_width * window_width + window_height * window_height);
+
+	for(int radius = thickness; radius < longest_distance; radius+= (thickness + gap)) {
+		planar_draw_thick_circle(plane, xc, yc, radius, thickness);
+	}
+}
+
+static uint8_t reversed_byte[256];
+
+static void make_reversed_bytes(void)
+{
+	for(int i = 0; i < 256; i++) {
+		uint8_t b = i;
+		b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+		b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+		reversed_byte[i] = (b & 0xaa) >> 1 | (b & 0x55) << 1;
+	}
+}
+
+static bool make_rings_quadrant(void)
+{
+	if(rings_quadrant_window_width == window_width && rings_quadrant_window_height == window_height)
+		return true;
+
+	int width = align(window_width + 1, 32);
+	int height = window_height + 1;
+	size_t size = (width / 8) * height;
+
+	if(size > rings_quadrant_size) {
+		uint8_t *data = backend_resize_reserved_memory(rings_quadrant.data_start, rings_quadrant_size, size);
+		if(data == NULL)
+			return false;
+
+		rings_quadrant.data_start = rings_quadrant.data = data;
+		rings_quadrant_size = size;
+	}
+
+	rings_quadrant.width = width;
+	rings_quadrant.height = height;
+	rings_quadrant.stride = width / 8;
+	planar_clear(&rings_quadrant);
+	draw_spotlight_rings(&rings_quadrant, 0, 0);
+
+	make_reversed_bytes();
+
+	rings_quadrant_window_width = window_width;
+	rings_quadrant_window_height = window_height;
+	return true;
+}
+
+/* OR quadrant row 'src' (pixels 0 to window_width inclusive) into 'dest'
+ * either side of the centre. */
+static void mirror_rings_row(uint8_t *dest, const uint8_t *src)
+{
+	int half = window_width / 8;
+
+	for(int i = 0; i < half; i++) {
+		// Right: pixel dx goes to window_width + dx.
+		dest[half + i] |= src[i];
+		// Left: pixel dx goes to window_width - dx, for dx from 1 to window_width.
+		dest[half - 1 - i] |= reversed_byte[(uint8_t)((src[i] << 1) | (src[i + 1] >> 7))];
+	}
+}
+
+/* The concentric rings the spotlights show, ORed into 'plane', which is
+ * normally twice the window size in each direction. */
+static void scene_draw_spotlight_rings(struct Bitplane *plane)
+{
+	if(plane->width != window_width * 2 || plane->height != window_height * 2
+			|| window_width % 8 != 0 || !make_rings_quadrant()) {
+		draw_spotlight_rings(plane, window_width, window_height);
+		return;
+	}
+
+	for(int dy = 0; dy <= window_height; dy++) {
+		const uint8_t *src = rings_quadrant.data + (dy * rings_quadrant.stride);
+
+		if(dy < window_height)
+			mirror_rings_row(plane->data + ((window_height + dy) * plane->stride), src);
+		if(dy > 0)
+			mirror_rings_row(plane->data + ((window_height - dy) * plane->stride), src);
+	}
+
+	struct BitplaneExtent *e = &rings_quadrant.drawn;
+	if(e->x1 >= e->x0)
+		planar_extent_add(plane, window_width - e->x1, window_height - e->y1, window_width + e->x1, window_height + e->y1);
+}
+
 bool scene_init_spotlights() {
 	// spot 0 trails all over the display -- this is defined in choreography
 
@@ -144,15 +264,9 @@ bool scene_init_spotlights() {
 	backend_bitplane[2].data = backend_bitplane[1].data;
 	backend_bitplane[2].data_start = backend_bitplane[1].data_start;
 
-	/* Scale backgrounds sensibly */
-	int thickness = max(4 * global_scale, 4);
-	int gap = (2 * thickness) / 3;
-
-	int longest_distance = sqrt1(window_width * window_width + window_height * window_height);
+	scene_draw_spotlight_rings(&backend_bitplane[1]);
 
-	for(int radius = thickness; radius < longest_distance; radius+= (thickness + gap)) {
-		planar_draw_thick_circle(&backend_bitplane[1], window_width, window_height, radius, thickness);
-	}
+	backend_bitplane[2].drawn = backend_bitplane[1].drawn;
 
 	return true;
 }
@@ -179,6 +293,123 @@ void scene_spotlights_tick(int cnt) {
 	backend_bitplane[2].data = backend_bitplane[2].data_start + (offsety * backend_bitplane[2].stride) + (offsetx / 8);
 }
 
+static char *find_text_for_idx(int idx, int *length_out);
+
+/* Draw a word at the top of planes 0-2 and return the area it covers. */
+static bool votevotevote_draw_word(int idx, struct BitplaneExtent *area)
+{
+	int text_length;
+	char *text = find_text_for_idx(idx, &text_length);
+
+	for(int i = 0; i < 3; i++)
+		planar_clear(&backend_bitplane[i]);
+
+	backend_font_draw(text_length, text, -1, 0);
+
+	*area = backend_bitplane[0].drawn;
+	for(int i = 1; i < 3; i++) {
+		struct BitplaneExtent *e = &backend_bitplane[i].drawn;
+		if(e->x1 < e->x0)
+			continue;
+		if(area->x1 < area->x0) {
+			*area = *e;
+		} else {
+			area->x0 = min(area->x0, e->x0);
+			area->y0 = min(area->y0, e->y0);
+			area->x1 = max(area->x1, e->x1);
+			area->y1 = max(area->y1, e->y1);
+		}
+	}
+
+	return area->x1 >= area->x0;
+}
+
+static size_t votevotevote_word_plane_size(struct BitplaneExtent *area)
+{
+	return (align(area->x1 - area->x0 + 1, 32) / 8) * (area->y1 - area->y0 + 1);
+}
+
+/* Uses planes 0-2 to draw in, which is fine as the first tick clears them. */
+static void votevotevote_prerender_words(void)
+{
+	int num_words = current_text_block->num_entries;
+	struct BitplaneExtent area;
+
+	votevotevote_words = NULL;
+	if(VOTEVOTEVOTE_WORD_CACHE_KB == 0)
+		return;
+
+	// Once to find out how much memory is needed...
+	size_t size = align(num_words * sizeof(struct votevotevote_word), sizeof(uintptr_t));
+	for(int i = 0; i < num_words; i++) {
+		if(votevotevote_draw_word(i, &area))
+			size += 3 * align(votevotevote_word_plane_size(&area), sizeof(uintptr_t));
+	}
+
+	if(size > VOTEVOTEVOTE_WORD_CACHE_KB * 1024)
+		return;
+
+	if(size > votevotevote_word_memory_size) {
+		uint8_t *memory = backend_resize_reserved_memory(votevotevote_word_memory, votevotevote_word_memory_size, size);
+		if(memory == NULL)
+			return;
+
+		votevotevote_word_memory = memory;
+		votevotevote_word_memory_size = size;
+	}
+
+	// ... and again to keep the words.
+	struct votevotevote_word *words = (struct votevotevote_word *)votevotevote_word_memory;
+	uint8_t *data = votevotevote_word_memory + align(num_words * sizeof(struct votevotevote_word), sizeof(uintptr_t));
+
+	for(int i = 0; i < num_words; i++) {
+		struct votevotevote_word *word = &words[i];
+
+		memset(word, 0, sizeof(*word));
+		if(!votevotevote_draw_word(i, &area))
+			continue;
+
+		word->x = area.x0;
+		word->y = area.y0;
+		word->width = area.x1 - area.x0 + 1;
+		word->height = area.y1 - area.y0 + 1;
+
+		for(int plane = 0; plane < 3; plane++) {
+			struct Bitplane *p = &word->planes[plane];
+			p->width = align(word->width, 32);
+			p->height = word->height;
+			p->stride = p->width / 8;
+			p->data = p->data_start = data;
+			data += align(votevotevote_word_plane_size(&area), sizeof(uintptr_t));
+		}
+
+		graphics_blit(backend_bitplane, word->planes, 7, word->x, word->y, word->width, word->height, 0, 0);
+	}
+
+	for(int i = 0; i < 3; i++)
+		planar_clear(&backend_bitplane[i]);
+
+	votevotevote_words = words;
+}
+
+/* The top and mid lines need at least one word each, and every word must
+ * lie within the 'length' bytes of effect data. */
+bool scene_votevotevote_data_valid(const void *effect_data, size_t length)
+{
+	const struct votevotevote_text_block *block = effect_data;
+
+	if(length < sizeof(*block) || block->num_entries < 6
+			|| block->num_entries >= (length - sizeof(*block)) / sizeof(uint16_t))
+		return false;
+
+	for(uint32_t i = 0; i < block->num_entries; i++) {
+		if(block->entries[i] > block->entries[i + 1])
+			return false;
+	}
+
+	return block->entries[block->num_entries] <= length - sizeof(*block);
+}
+
 void scene_init_votevotevote(void *effect_data, uint32_t *palette_a, uint32_t *palette_b)
 {
 	votevotevote_last_palette = 0; // light palette
@@ -194,6 +425,8 @@ void scene_init_votevotevote(void *effect_data, uint32_t *palette_a, uint32_t *p
 	votevotevote_palette_a = palette_a;
 	votevotevote_palette_b = palette_b;
 
+	votevotevote_prerender_words();
+
 	//printf("counts %d %d %d %d\n", votevotevote_topline_count, votevotevote_midline_count, votevotevote_botline_count, current_text_block->num_entries);
 }
 
@@ -211,14 +444,58 @@ static char *find_text_for_idx(int idx, int *length_out)
 	return ((char *)current_text_block->entries) + offset;
 }
 
+/* Where line 'line' (0-2) of the text starts. */
+static int votevotevote_line_y(int line)
+{
+	int font_height = backend_font_get_height();
+
+	return ((window_height / 2) - (font_height / 2)) - font_height + (line * font_height);
+}
+
+static void votevotevote_clear_word(int line, int idx)
+{
+	struct votevotevote_word *word = &votevotevote_words[idx];
+	int y = votevotevote_line_y(line) + word->y;
+
+	if(word->width == 0)
+		return;
+
+	for(int i = 0; i < 3; i++)
+		planar_clear_rect(&backend_bitplane[i], word->x, y, word->x + word->width - 1, y + word->height - 1);
+}
+
+static void votevotevote_show_word(int line, int idx)
+{
+	if(votevotevote_words) {
+		struct votevotevote_word *word = &votevotevote_words[idx];
+
+		if(word->width)
+			graphics_blit(word->planes, backend_bitplane, 7, 0, 0, word->width, word->height, word->x, votevotevote_line_y(line) + word->y);
+	} else {
+		int text_length;
+		char *text = find_text_for_idx(idx, &text_length);
+
+		backend_font_draw(text_length, text, -1, votevotevote_line_y(line));
+	}
+}
+
 void scene_votevotevote_tick(int ms)
 {
 	if(votevotevote_last_ms + VOTEVOTEVOTE_DISPLAY_MS > ms)
 		return;
 
-	// TODO we only need to clear the bounding box.
-	for(int i = 0; i < 3; i++) {
-		planar_clear(&backend_bitplane[i]);
+	int mid_base = votevotevote_topline_count;
+	int bot_base = votevotevote_topline_count + votevotevote_midline_count;
+
+	if(votevotevote_words == NULL || votevotevote_top < 0) {
+		for(int i = 0; i < 3; i++) {
+			planar_clear(&backend_bitplane[i]);
+		}
+	} else {
+		// only the previous words need to go
+		votevotevote_clear_word(0, votevotevote_top);
+		votevotevote_clear_word(1, votevotevote_mid + mid_base);
+		votevotevote_clear_word(2, votevotevote_bot + bot_base);
 	}
 
 	int top_text_idx = backend_random() % votevotevote_topline_count;
@@ -235,31 +512,16 @@ void scene_votevotevote_tick(int ms)
 	if(bot_text_idx == votevotevote_bot) 
 		bot_text_idx = (bot_text_idx + 1) % votevotevote_botline_count;
 
-	int font_height = backend_font_get_height();
-	int text_length;
-	char *text;
-
 	if(votevotevote_last_palette == 1)
-		backend_set_palette(32, votevotevote_palette_a);
+		palette_set(32, votevotevote_palette_a);
 	else
-		backend_set_palette(32, votevotevote_palette_b);
+		palette_set(32, votevotevote_palette_b);
 
 	votevotevote_last_palette = 1 - votevotevote_last_palette;
 
-	int y = ((window_height / 2) - (font_height / 2)) - font_height;
-
-	text = find_text_for_idx(top_text_idx, &text_length);
-	backend_font_draw(text_length, text, -1, y);
-
-	y += font_height;
-
-	text = find_text_for_idx(mid_text_idx + votevotevote_topline_count, &text_length);
-	backend_font_draw(text_length, text, -1, y);
-
-	y += font_height;
-
-	text = find_text_for_idx(bot_text_idx + votevotevote_topline_count + votevotevote_midline_count, &text_length);
-	backend_font_draw(text_length, text, -1, y);
+	votevotevote_show_word(0, top_text_idx);
+	votevotevote_show_word(1, mid_text_idx + mid_base);
+	votevotevote_show_word(2, bot_text_idx + bot_base);
 	
 	votevotevote_last_ms = ms;
 	votevotevote_top = top_text_idx;
@@ -275,10 +537,30 @@ void scene_init_delayedblit()
 	delayed_blit_next_blit = 0;
 }
 
+/* Move each plane's picture up one, from 'bottom' to 'top'. Like the onion
+ * skin, this rotates the plane structs rather than copying the pictures;
+ * 'bottom', which is still being drawn into, gets the oldest plane back,
+ * updated from the newest by copying only what's been drawn. */
 static void delayedblit_do_copy(int top, int bottom)
 {
-	for(int plane_idx = top; plane_idx > bottom; plane_idx--)
-		backend_copy_bitplane(&backend_bitplane[plane_idx], &backend_bitplane[plane_idx - 1]);
+	struct Bitplane *planes = backend_bitplane;
+
+	for(int i = bottom; i <= top; i++) {
+		if(planes[i].width != planes[bottom].width || planes[i].height != planes[bottom].height
+				|| planes[i].data != planes[i].data_start) {
+			// Not a simple stack of planes, so do it the slow way.
+			for(int plane_idx = top; plane_idx > bottom; plane_idx--)
+				backend_copy_bitplane(&planes[plane_idx], &planes[plane_idx - 1]);
+			return;
+		}
+	}
+
+	struct Bitplane oldest = planes[top];
+	for(int i = top; i > bottom; i--)
+		planes[i] = planes[i - 1];
+	planes[bottom] = oldest;
+
+	planar_copy_drawn(&planes[bottom + 1], &planes[bottom]);
 }
 
 void scene_delayedblit_tick(int ms)
@@ -369,7 +651,7 @@ static void copperpastels_set_corners(int ms) {
 
 	uint8_t multiplier;
 	if(g_copperpastels_effect_data->palette_fade_ref != -1) {
-		multiplier = (0xff0000 & backend_get_palette_element(g_copperpastels_effect_data->palette_fade_ref)) >> 16;
+		multiplier = (0xff0000 & palette_get_element(g_copperpastels_effect_data->palette_fade_ref)) >> 16;
 	} else {
 		multiplier = 0xff;
 	}
@@ -404,6 +686,16 @@ static void scene_copperpastels_do_copper_effect(int x, int y, uint32_t *palette
 	palette[2] = copperpastels_get(COPPER_PASTELS_WIDTH - x, COPPER_PASTELS_HEIGHT - y);
 }
 
+bool scene_copperpastels_data_valid(const void *effect_data, size_t length)
+{
+	const struct copperpastels_effect_data_struct *data = effect_data;
+
+	return length >= sizeof(*data)
+		&& data->num_pastels > 0
+		&& data->num_pastels <= (length - sizeof(*data)) / sizeof(struct pastel)
+		&& data->palette_fade_ref >= -1 && data->palette_fade_ref < 32;
+}
+
 void scene_init_copperpastels(int ms, void *v_data)
 {
 	struct copperpastels_effect_data_struct *effect_data_in = v_data;
@@ -454,15 +746,6 @@ void scene_deinit_copperpastels()
 	backend_register_copper_func(NULL);
 }
 
-/* TODO: fitting this into memory constraints -- we can do font at 4 bitplanes, buuut... 
- * ... it is just random bits plus some circle parts, so maybe regenerating it at each
- * change (every 80 ms) is okay */
-void scene_init_static(int ms, void *data)
-{
-	static_ticks_count = 0;
-	static_rngstate.state = 0x57a7e0fa27ULL;
-}
-
 /* In terms of global_scale which is based on a 256x256 display.
  * Each frame has two circle groups. */
 static const int16_t static_circles_radii[] = {
@@ -471,56 +754,141 @@ static const int16_t static_circles_radii[] = {
 	75, 115,
 	105, 135};
 
-static const int static_num_frames = 4; // fair dice roll
+#define STATIC_NUM_FRAMES 4 // fair dice roll
+
+#define STATIC_BITPLANE_NUM 0
+
+/* The static is a short cycle of frames of noise plus circles, made when the
+ * effect starts (and kept while the plane size stays the same), then shown
+ * by pointing the plane at each in turn. */
+static uint8_t *static_frames[STATIC_NUM_FRAMES];
+static size_t static_frame_size;
+static int static_frames_width, static_frames_height, static_frames_stride;
+static uint8_t *static_plane_data; // the plane's own memory, given back at deinit
+
+/* Eight xorshift32 generators stepped side by side produce 32 bytes at a
+ * time. The lanes are independent so the loop vectorises. */
+#define NOISE_LANES 8
+
+struct noise {
+	uint32_t lane[NOISE_LANES];
+};
 
-void _draw_static_to_plane(struct Bitplane *plane)
+static void noise_seed(struct noise *noise, pcg32_random_t *rng)
 {
-	uint32_t random;
-	random = pcg32_random_r(&static_rngstate);
-	int bytes_avail = 4;
+	for(int i = 0; i < NOISE_LANES; i++) {
+		do {
+			noise->lane[i] = pcg32_random_r(rng);
+		} while(noise->lane[i] == 0); // xorshift's one fixed point
+	}
+}
 
-	uint8_t *ptr = plane->data;
+static void noise_fill(struct noise *noise, uint8_t *dest, size_t length)
+{
+	while(length) {
+		for(int i = 0; i < NOISE_LANES; i++) {
+			uint32_t x = noise->lane[i];
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			noise->lane[i] = x;
+		}
+
+		size_t amt = min(length, sizeof(noise->lane));
+		memcpy(dest, noise->lane, amt);
+		dest += amt;
+		length -= amt;
+	}
+}
+
+static void _draw_static_to_plane(struct Bitplane *plane, struct noise *noise)
+{
+	// rows are contiguous, so fill the padding too rather than stepping over it
+	noise_fill(noise, plane->data_start, plane->stride * plane->height);
+
+	planar_extent_full(plane);
+}
 
-	for(int y = 0; y < plane->height; y++) {
-		for(int x = 0; x < plane->width / 8; x++) {
-			ptr[x] = random & 0xff;
-			bytes_avail --;
-			if(!bytes_avail) {
-				random = pcg32_random_r(&static_rngstate);
-				bytes_avail = 4;
-			} else {
-				random >>= 8;
-			}
+static bool make_static_frames(struct Bitplane *model)
+{
+	if(static_frames_width == model->width && static_frames_height == model->height
+			&& static_frames_stride == model->stride)
+		return true;
+
+	size_t size = model->stride * model->height;
+	if(size > static_frame_size) {
+		// the old frames are lost even if this fails part way
+		static_frames_width = static_frames_height = 0;
+		for(int i = 0; i < STATIC_NUM_FRAMES; i++) {
+			uint8_t *frame = backend_resize_reserved_memory(static_frames[i], static_frame_size, size);
+			if(frame == NULL)
+				return false;
+			static_frames[i] = frame;
 		}
+		static_frame_size = size;
+	}
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0x57a7e0fa27ULL, 37);
 
-		ptr += plane->stride;
+	struct noise noise;
+	noise_seed(&noise, &rng);
+
+	for(int frame = 0; frame < STATIC_NUM_FRAMES; frame++) {
+		struct Bitplane plane = *model;
+		plane.data = plane.data_start = static_frames[frame];
+
+		_draw_static_to_plane(&plane, &noise);
+
+		// Several circles clustered around the midpoint.
+		for(int radii_idx = frame * 2; radii_idx < frame * 2 + 2; radii_idx++) {
+			int radius = static_circles_radii[radii_idx] * global_scale;
+			planar_circle(&plane, window_width / 2, window_height / 2, radius);
+			planar_circle(&plane, 4 * global_scale + window_width / 2, window_height / 2, radius);
+			planar_circle(&plane, window_width / 2, 4 * global_scale + window_height / 2, radius);
+			planar_circle(&plane, 2 * global_scale + window_width / 2, 2 * global_scale + window_height / 2, radius);
+		}
 	}
 
+	static_frames_width = model->width;
+	static_frames_height = model->height;
+	static_frames_stride = model->stride;
+	return true;
 }
 
-#define STATIC_BITPLANE_NUM 0
+static bool is_static_frame(uint8_t *data)
+{
+	for(int i = 0; i < STATIC_NUM_FRAMES; i++) {
+		if(data == static_frames[i])
+			return true;
+	}
 
-void scene_static_tick(int ms)
+	return false;
+}
+
+void scene_init_static(int ms, void *data)
 {
-	if(static_ticks_count % STATIC_SWITCH_SPEED_TICKS == 0) {
-		int frame = (static_ticks_count / STATIC_SWITCH_SPEED_TICKS) % static_num_frames;
+	struct Bitplane *plane = &backend_bitplane[STATIC_BITPLANE_NUM];
 
-		static_rngstate.inc = 37 + frame;
+	static_ticks_count = 0;
 
-		_draw_static_to_plane(&backend_bitplane[STATIC_BITPLANE_NUM]);
+	// A restored snapshot may already have the plane showing a frame.
+	if(!is_static_frame(plane->data_start))
+		static_plane_data = plane->data_start;
 
-		int radii_idx = frame * 2;
+	if(!make_static_frames(plane))
+		backend_debug("static: couldn't make frames");
+}
 
-		// Several circles clustered around the midpoint.
-		//planar_draw_thick_circle(&backend_bitplane[0], window_width / 2, window_height / 2, 25, 2);
+void scene_static_tick(int ms)
+{
+	if(static_ticks_count % STATIC_SWITCH_SPEED_TICKS == 0) {
+		int frame = (static_ticks_count / STATIC_SWITCH_SPEED_TICKS) % STATIC_NUM_FRAMES;
 		struct Bitplane *plane = &backend_bitplane[STATIC_BITPLANE_NUM];
 
-		for(int max_idx = radii_idx + 2; radii_idx < max_idx; radii_idx ++) {
-			int radius = static_circles_radii[radii_idx] * global_scale;
-			planar_circle(plane, window_width / 2, window_height / 2, radius);
-			planar_circle(plane, 4 * global_scale + window_width / 2, window_height / 2, radius);
-			planar_circle(plane, window_width / 2, 4 * global_scale + window_height / 2, radius);
-			planar_circle(plane, 2 * global_scale + window_width / 2, 2 * global_scale + window_height / 2, radius);
+		if(static_frames[frame] && plane->stride == static_frames_stride && plane->height == static_frames_height) {
+			plane->data = plane->data_start = static_frames[frame];
+			planar_extent_full(plane);
 		}
 
 		delayedblit_do_copy(3, 1);
@@ -528,8 +896,15 @@ void scene_static_tick(int ms)
 	static_ticks_count += 1;
 }
 
+/* Give the plane its own memory back, still showing the last frame. */
 void scene_deinit_static()
 {
+	struct Bitplane *plane = &backend_bitplane[STATIC_BITPLANE_NUM];
+
+	if(static_plane_data && is_static_frame(plane->data_start)) {
+		memcpy(static_plane_data, plane->data_start, plane->stride * plane->height);
+		plane->data = plane->data_start = static_plane_data;
+	}
 }
 
 #define STATIC2_BITPLANE_NUM 5
@@ -618,3 +993,53 @@ void scene_deinit_static2()
 }
 
 
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+/* Effect progress. Pointers are left alone: they're set up again when the
+ * effect is re-initialised. */
+struct scene_snapshot {
+	int votevotevote_last_palette, votevotevote_last_ms;
+	int votevotevote_top, votevotevote_mid, votevotevote_bot;
+	int delayed_blit_next_blit, delayed_blit_delay;
+	int copperpastels_ms_start;
+	int static_ticks_count;
+	pcg32_random_t static_rngstate;
+};
+
+size_t scene_snapshot_size(void)
+{
+	return sizeof(struct scene_snapshot);
+}
+
+void scene_snapshot_save(void *dest)
+{
+	struct scene_snapshot *snap = dest;
+
+	snap->votevotevote_last_palette = votevotevote_last_palette;
+	snap->votevotevote_last_ms = votevotevote_last_ms;
+	snap->votevotevote_top = votevotevote_top;
+	snap->votevotevote_mid = votevotevote_mid;
+	snap->votevotevote_bot = votevotevote_bot;
+	snap->delayed_blit_next_blit = delayed_blit_next_blit;
+	snap->delayed_blit_delay = delayed_blit_delay;
+	snap->copperpastels_ms_start = copperpastels_ms_start;
+	snap->static_ticks_count = static_ticks_count;
+	snap->static_rngstate = static_rngstate;
+}
+
+void scene_snapshot_restore(const void *src)
+{
+	const struct scene_snapshot *snap = src;
+
+	votevotevote_last_palette = snap->votevotevote_last_palette;
+	votevotevote_last_ms = snap->votevotevote_last_ms;
+	votevotevote_top = snap->votevotevote_top;
+	votevotevote_mid = snap->votevotevote_mid;
+	votevotevote_bot = snap->votevotevote_bot;
+	delayed_blit_next_blit = snap->delayed_blit_next_blit;
+	delayed_blit_delay = snap->delayed_blit_delay;
+	copperpastels_ms_start = snap->copperpastels_ms_start;
+	static_ticks_count = snap->static_ticks_count;
+	static_rngstate = snap->static_rngstate;
+}
+#endif
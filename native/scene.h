@@ -1,10 +1,12 @@
 #include <stdbool.h>
+#include <stddef.h>
 
 void scene_init();
 bool scene_init_spotlights();
 void scene_spotlights_tick(int cnt);
 void scene_deinit_spotlights();
 
+bool scene_votevotevote_data_valid(const void *effect_data, size_t length);
 void scene_init_votevotevote(void *effect_data, uint32_t *palette_a, uint32_t *palette_b);
 void scene_votevotevote_tick(int ms);
 void scene_deinit_votevotevote();
@@ -13,6 +15,7 @@ void scene_init_delayedblit();
 void scene_delayedblit_tick(int ms);
 void scene_deinit_delayedblit();
 
+bool scene_copperpastels_data_valid(const void *effect_data, size_t length);
 void scene_init_copperpastels(int ms, void *effect_data);
 void scene_copperpastels_tick(int ms);
 void scene_deinit_copperpastels();
@@ -25,3 +28,9 @@ void scene_init_static2(int ms, void *effect_data);
 void scene_static2_tick(int ms);
 void scene_deinit_static2();
 
+
+#ifdef BACKEND_SUPPORTS_SNAPSHOTS
+size_t scene_snapshot_size(void);
+void scene_snapshot_save(void *dest);
+void scene_snapshot_restore(const void *src);
+#endif
@@ -2,10 +2,17 @@
 
 bool sound_init(bool nosound);
 bool sound_deinit();
-bool sound_mod_play(int mod);
+// start_ms is the demo time at which the music starts, for sound_get_demo_ms()
+bool sound_mod_play(int mod, int start_ms);
 bool sound_mod_stop();
-bool sound_mp3_play(int mp3);
+bool sound_mp3_play(int mp3, int start_ms);
 bool sound_mp3_stop();
 bool sound_sample_play(int sample_idx);
 void sound_update(void);
 
+/* The demo time currently being heard, from how much music the audio device
+ * has consumed. Returns false if no music is playing. */
+bool sound_get_demo_ms(int *ms_out);
+/* Output latency beyond what the sound backend accounts for itself. */
+void sound_set_latency_ms(int latency_ms);
+
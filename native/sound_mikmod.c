@@ -19,6 +19,15 @@ static bool nosound;
 
 static MODULE *current_mod;
 int mod_file_idx;
+static int mod_start_ms;
+static int latency_ms;
+static int driver_latency_ms;
+
+/* Mikmod doesn't say how much its driver has buffered. Assume one buffer of
+ * this many sample frames, as the SDL_mixer backend uses. */
+#ifndef MIKMOD_DRIVER_BUFFER_SAMPLES
+#define MIKMOD_DRIVER_BUFFER_SAMPLES 4096
+#endif
 
 static SAMPLE *current_sample;
 int snd_file_idx;
@@ -94,12 +103,14 @@ bool sound_init(bool arg_nosound)
 
 		MikMod_SetNumVoices(-1, 1);
 		MikMod_EnableOutput();
+
+		driver_latency_ms = md_mixfreq ? (MIKMOD_DRIVER_BUFFER_SAMPLES * 1000) / md_mixfreq : 0;
 	}
 
 	return true;
 }
 
-bool sound_mod_play(int new_mod_idx)
+bool sound_mod_play(int new_mod_idx, int start_ms)
 {
 	if(nosound)
 		return true;
@@ -113,9 +124,27 @@ bool sound_mod_play(int new_mod_idx)
 	}
 
 	Player_Start(current_mod);
+	mod_start_ms = start_ms;
+	return true;
+}
+
+bool sound_get_demo_ms(int *ms_out)
+{
+	if(nosound || current_mod == NULL || !Player_Active())
+		return false;
+
+	/* sngtime is in 1/1024ths of a second and counts what the player has
+	 * mixed; what has been heard is a driver buffer behind that. */
+	int played_ms = (int)(((uint64_t)current_mod->sngtime * 1000) >> 10) - driver_latency_ms;
+	*ms_out = mod_start_ms + played_ms - latency_ms;
 	return true;
 }
 
+void sound_set_latency_ms(int latency_ms_in)
+{
+	latency_ms = latency_ms_in;
+}
+
 bool sound_mod_stop()
 {
 	if(nosound)
@@ -125,7 +154,7 @@ bool sound_mod_stop()
 	return true;
 }
 
-bool sound_mp3_play(int new_mp3_idx)
+bool sound_mp3_play(int new_mp3_idx, int start_ms)
 {
 	//  Unsupported under mikmod
 	return true;
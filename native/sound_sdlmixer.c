@@ -15,6 +15,7 @@
 #include "wad.h"
 #include "sound.h"
 #include "backend.h"
+#include "minmax.h"
 
 #ifdef EMULATE_FMEMOPEN
 #include "fmemopen.h"
@@ -31,6 +32,25 @@ static Mix_Music *current_mus;
 static SDL_RWops *current_mus_rwops;
 int mus_file_idx;
 
+// Samples per buffer. A buffer is mixed one buffer ahead of the device.
+#define BUFFER_SAMPLES 4096
+
+/* Music position, counted by the post-mix callback. Written by the audio
+ * thread, so access it with the audio locked. */
+static uint64_t frames_mixed;
+static uint64_t last_mix_ms;
+static int mix_frequency, mix_frame_size;
+static int mus_start_ms;
+static int latency_ms;
+
+static void count_mixed(void *udata, Uint8 *stream, int len)
+{
+	if(Mix_PlayingMusic()) {
+		frames_mixed += len / mix_frame_size;
+		last_mix_ms = backend_get_time_ms();
+	}
+}
+
 static SDL_RWops *_load(int idx) {
 	size_t size;
 
@@ -66,7 +86,7 @@ void sound_update(void)
 }
 
 
-bool sound_mod_play(int new_mod_idx)
+bool sound_mod_play(int new_mod_idx, int start_ms)
 {
 	// Unsupported using sdl mixer backend
 	return true;
@@ -78,7 +98,7 @@ bool sound_mod_stop()
 	return true;
 }
 
-bool sound_mp3_play(int new_mp3_idx)
+bool sound_mp3_play(int new_mp3_idx, int start_ms)
 {
 	if(nosound)
 		return true;
@@ -93,6 +113,13 @@ bool sound_mp3_play(int new_mp3_idx)
 		current_mus_rwops = _load(new_mp3_idx);
 		current_mus = Mix_LoadMUS_RW(current_mus_rwops);
 		mus_file_idx = new_mp3_idx;
+
+		SDL_LockAudio();
+		frames_mixed = 0;
+		last_mix_ms = backend_get_time_ms();
+		SDL_UnlockAudio();
+		mus_start_ms = start_ms;
+
 		Mix_PlayMusic(current_mus, -1);
 	}
 
@@ -107,6 +134,31 @@ bool sound_mp3_stop()
 	return true;
 }
 
+bool sound_get_demo_ms(int *ms_out)
+{
+	if(nosound || mix_frame_size == 0 || !Mix_PlayingMusic())
+		return false;
+
+	SDL_LockAudio();
+	uint64_t frames = frames_mixed;
+	uint64_t since_mix_ms = backend_get_time_ms() - last_mix_ms;
+	SDL_UnlockAudio();
+
+	/* The callback fires once per buffer, so interpolate between calls, but
+	 * not beyond the buffer the device is playing. */
+	int mixed_ms = (int)((frames * 1000) / mix_frequency);
+	int buffer_ms = (BUFFER_SAMPLES * 1000) / mix_frequency;
+	int played_ms = mixed_ms - buffer_ms + (int)min(since_mix_ms, (uint64_t)buffer_ms);
+
+	*ms_out = mus_start_ms + played_ms - latency_ms;
+	return true;
+}
+
+void sound_set_latency_ms(int latency_ms_in)
+{
+	latency_ms = latency_ms_in;
+}
+
 bool sound_sample_play(int sample_idx)
 {
 	if(nosound)
@@ -141,10 +193,17 @@ bool sound_init(bool arg_nosound)
 		// Note: this requires a patched SDL_mixer currently
 		//succeeded = Mix_OpenAudioDevice(44100, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS,
 		//		4096, NULL, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE) != -1;
-		succeeded = Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS, 4096) != -1;
+		succeeded = Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS, BUFFER_SAMPLES) != -1;
 #else
-		succeeded = Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS, 4096) != -1;
+		succeeded = Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS, BUFFER_SAMPLES) != -1;
 #endif
+
+		Uint16 format;
+		int channels;
+		if(succeeded && Mix_QuerySpec(&mix_frequency, &format, &channels)) {
+			mix_frame_size = channels * ((format & 0xff) / 8);
+			Mix_SetPostMix(count_mixed, NULL);
+		}
 	}
 
 	return succeeded;
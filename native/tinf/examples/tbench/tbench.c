@@ -0,0 +1,97 @@
+/*
+ * tbench  -  inflate throughput benchmark
+ *
+ * Decompresses a zlib stream repeatedly, checks the result against the
+ * original data, and reports throughput. Build it with and without
+ * TINF_SMALL to compare the two decoders (see makefile.elf).
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tinf.h"
+
+void exit_error(const char *what)
+{
+   printf("ERROR: %s\n", what);
+   exit(1);
+}
+
+unsigned char *read_file(const char *filename, unsigned int *len)
+{
+   FILE *fin;
+   unsigned char *data;
+
+   if ((fin = fopen(filename, "rb")) == NULL) exit_error(filename);
+
+   fseek(fin, 0, SEEK_END);
+   *len = ftell(fin);
+   fseek(fin, 0, SEEK_SET);
+
+   if ((data = (unsigned char *)malloc(*len ? *len : 1)) == NULL) exit_error("memory");
+   if (fread(data, 1, *len, fin) != *len) exit_error("read");
+
+   fclose(fin);
+
+   return data;
+}
+
+double now_seconds(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned int raw_len, zlib_len, outlen;
+   unsigned char *raw, *source, *dest;
+   void *tinf_data;
+   int i, iterations;
+   double start, elapsed;
+
+   if (argc < 3)
+   {
+      printf("Syntax: tbench <original> <zlib stream> [iterations]\n");
+      return 1;
+   }
+
+   iterations = argc > 3 ? atoi(argv[3]) : 100;
+
+   tinf_init();
+
+   raw = read_file(argv[1], &raw_len);
+   source = read_file(argv[2], &zlib_len);
+
+   if ((dest = (unsigned char *)malloc(raw_len ? raw_len : 1)) == NULL) exit_error("memory");
+   if ((tinf_data = malloc(tinf_data_size())) == NULL) exit_error("memory");
+
+   /* check it decompresses correctly before timing it */
+   outlen = raw_len;
+   if (tinf_zlib_uncompress(dest, &outlen, source, zlib_len, tinf_data) != TINF_OK
+         || outlen != raw_len || memcmp(dest, raw, raw_len) != 0)
+      exit_error("inflate");
+
+   start = now_seconds();
+
+   for (i = 0; i < iterations; ++i)
+   {
+      outlen = raw_len;
+      tinf_zlib_uncompress(dest, &outlen, source, zlib_len, tinf_data);
+   }
+
+   elapsed = now_seconds() - start;
+
+   printf("%s: %u -> %u bytes, %d iterations, %.3f ms each, %.1f MB/s (state %u bytes)\n",
+          argv[2], zlib_len, raw_len, iterations, elapsed * 1000 / iterations,
+          (double)raw_len * iterations / elapsed / (1024 * 1024), (unsigned int)tinf_data_size());
+
+   return 0;
+}
@@ -32,6 +32,9 @@ extern "C" {
 
 /* function prototypes */
 
+/* *destLen is the capacity of dest on entry, and the number of bytes
+   written on return. Streams that don't fit are a TINF_DATA_ERROR. */
+
 void TINFCC tinf_init();
 
 size_t tinf_data_size();
@@ -1,462 +1,971 @@
-/*
- * tinflate  -  tiny inflate
- *
- * Copyright (c) 2003 by Joergen Ibsen / Jibz
- * All Rights Reserved
- *
- * http://www.ibsensoftware.com/
- *
- * This software is provided 'as-is', without any express
- * or implied warranty.  In no event will the authors be
- * held liable for any damages arising from the use of
- * this software.
- *
- * Permission is granted to anyone to use this software
- * for any purpose, including commercial applications,
- * and to alter it and redistribute it freely, subject to
- * the following restrictions:
- *
- * 1. The origin of this software must not be
- *    misrepresented; you must not claim that you
- *    wrote the original software. If you use this
- *    software in a product, an acknowledgment in
- *    the product documentation would be appreciated
- *    but is not required.
- *
- * 2. Altered source versions must be plainly marked
- *    as such, and must not be misrepresented as
- *    being the original software.
- *
- * 3. This notice may not be removed or altered from
- *    any source distribution.
- */
-
-#include "tinf.h"
-
-/* ------------------------------ *
- * -- internal data structures -- *
- * ------------------------------ */
-
-typedef struct {
-   unsigned short table[16];  /* table of code length counts */
-   unsigned short trans[288]; /* code -> symbol translation table */
-} TINF_TREE;
-
-typedef struct {
-   const unsigned char *source;
-   unsigned int tag;
-   unsigned int bitcount;
-
-   unsigned char *dest;
-   unsigned int *destLen;
-
-   TINF_TREE ltree; /* dynamic length/symbol tree */
-   TINF_TREE dtree; /* dynamic distance tree */
-} TINF_DATA;
-
-/* --------------------------------------------------- *
- * -- uninitialized global data (static structures) -- *
- * --------------------------------------------------- */
-
-TINF_TREE sltree; /* fixed length/symbol tree */
-TINF_TREE sdtree; /* fixed distance tree */
-
-/* extra bits and base tables for length codes */
-unsigned char length_bits[30];
-unsigned short length_base[30];
-
-/* extra bits and base tables for distance codes */
-unsigned char dist_bits[30];
-unsigned short dist_base[30];
-
-/* special ordering of code length codes */
-const unsigned char clcidx[] = {
-   16, 17, 18, 0, 8, 7, 9, 6,
-   10, 5, 11, 4, 12, 3, 13, 2,
-   14, 1, 15
-};
-
-/* ----------------------- *
- * -- utility functions -- *
- * ----------------------- */
-
-/* build extra bits and base tables */
-static void tinf_build_bits_base(unsigned char *bits, unsigned short *base, int delta, int first)
-{
-   int i, sum;
-
-   /* build bits table */
-   for (i = 0; i < delta; ++i) bits[i] = 0;
-   for (i = 0; i < 30 - delta; ++i) bits[i + delta] = i / delta;
-
-   /* build base table */
-   for (sum = first, i = 0; i < 30; ++i)
-   {
-      base[i] = sum;
-      sum += 1 << bits[i];
-   }
-}
-
-/* build the fixed huffman trees */
-static void tinf_build_fixed_trees(TINF_TREE *lt, TINF_TREE *dt)
-{
-   int i;
-
-   /* build fixed length tree */
-   for (i = 0; i < 7; ++i) lt->table[i] = 0;
-
-   lt->table[7] = 24;
-   lt->table[8] = 152;
-   lt->table[9] = 112;
-
-   for (i = 0; i < 24; ++i) lt->trans[i] = 256 + i;
-   for (i = 0; i < 144; ++i) lt->trans[24 + i] = i;
-   for (i = 0; i < 8; ++i) lt->trans[24 + 144 + i] = 280 + i;
-   for (i = 0; i < 112; ++i) lt->trans[24 + 144 + 8 + i] = 144 + i;
-
-   /* build fixed distance tree */
-   for (i = 0; i < 5; ++i) dt->table[i] = 0;
-
-   dt->table[5] = 32;
-
-   for (i = 0; i < 32; ++i) dt->trans[i] = i;
-}
-
-/* given an array of code lengths, build a tree */
-static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned int num)
-{
-   unsigned short offs[16];
-   unsigned int i, sum;
-
-   /* clear code length count table */
-   for (i = 0; i < 16; ++i) t->table[i] = 0;
-
-   /* scan symbol lengths, and sum code length counts */
-   for (i = 0; i < num; ++i) t->table[lengths[i]]++;
-
-   t->table[0] = 0;
-
-   /* compute offset table for distribution sort */
-   for (sum = 0, i = 0; i < 16; ++i)
-   {
-      offs[i] = sum;
-      sum += t->table[i];
-   }
-
-   /* create code->symbol translation table (symbols sorted by code) */
-   for (i = 0; i < num; ++i)
-   {
-      if (lengths[i]) t->trans[offs[lengths[i]]++] = i;
-   }
-}
-
-/* ---------------------- *
- * -- decode functions -- *
- * ---------------------- */
-
-/* get one bit from source stream */
-static int tinf_getbit(TINF_DATA *d)
-{
-   unsigned int bit;
-
-   /* check if tag is empty */
-   if (!d->bitcount--)
-   {
-      /* load next tag */
-      d->tag = *d->source++;
-      d->bitcount = 7;
-   }
-
-   /* shift bit out of tag */
-   bit = d->tag & 0x01;
-   d->tag >>= 1;
-
-   return bit;
-}
-
-/* read a num bit value from a stream and add base */
-static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
-{
-   unsigned int val = 0;
-
-   /* read num bits */
-   if (num)
-   {
-      unsigned int limit = 1 << (num);
-      unsigned int mask;
-
-      for (mask = 1; mask < limit; mask *= 2)
-         if (tinf_getbit(d)) val += mask;
-   }
-
-   return val + base;
-}
-
-/* given a data stream and a tree, decode a symbol */
-static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
-{
-   int sum = 0, cur = 0, len = 0;
-
-   /* get more bits while code value is above sum */
-   do {
-
-      cur = 2*cur + tinf_getbit(d);
-
-      ++len;
-
-      sum += t->table[len];
-      cur -= t->table[len];
-
-   } while (cur >= 0);
-
-   return t->trans[sum + cur];
-}
-
-/* given a data stream, decode dynamic trees from it */
-static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
-{
-   TINF_TREE code_tree;
-   unsigned char lengths[288+32];
-   unsigned int hlit, hdist, hclen;
-   unsigned int i, num, length;
-
-   /* get 5 bits HLIT (257-286) */
-   hlit = tinf_read_bits(d, 5, 257);
-
-   /* get 5 bits HDIST (1-32) */
-   hdist = tinf_read_bits(d, 5, 1);
-
-   /* get 4 bits HCLEN (4-19) */
-   hclen = tinf_read_bits(d, 4, 4);
-
-   for (i = 0; i < 19; ++i) lengths[i] = 0;
-
-   /* read code lengths for code length alphabet */
-   for (i = 0; i < hclen; ++i)
-   {
-      /* get 3 bits code length (0-7) */
-      unsigned int clen = tinf_read_bits(d, 3, 0);
-
-      lengths[clcidx[i]] = clen;
-   }
-
-   /* build code length tree */
-   tinf_build_tree(&code_tree, lengths, 19);
-
-   /* decode code lengths for the dynamic trees */
-   for (num = 0; num < hlit + hdist; )
-   {
-      int sym = tinf_decode_symbol(d, &code_tree);
-
-      switch (sym)
-      {
-      case 16:
-         /* copy previous code length 3-6 times (read 2 bits) */
-         {
-            unsigned char prev = lengths[num - 1];
-            for (length = tinf_read_bits(d, 2, 3); length; --length)
-            {
-               lengths[num++] = prev;
-            }
-         }
-         break;
-      case 17:
-         /* repeat code length 0 for 3-10 times (read 3 bits) */
-         for (length = tinf_read_bits(d, 3, 3); length; --length)
-         {
-            lengths[num++] = 0;
-         }
-         break;
-      case 18:
-         /* repeat code length 0 for 11-138 times (read 7 bits) */
-         for (length = tinf_read_bits(d, 7, 11); length; --length)
-         {
-            lengths[num++] = 0;
-         }
-         break;
-      default:
-         /* values 0-15 represent the actual code lengths */
-         lengths[num++] = sym;
-         break;
-      }
-   }
-
-   /* build dynamic trees */
-   tinf_build_tree(lt, lengths, hlit);
-   tinf_build_tree(dt, lengths + hlit, hdist);
-}
-
-/* ----------------------------- *
- * -- block inflate functions -- *
- * ----------------------------- */
-
-/* given a stream and two trees, inflate a block of data */
-static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
-{
-   /* remember current output position */
-   unsigned char *start = d->dest;
-
-   while (1)
-   {
-      int sym = tinf_decode_symbol(d, lt);
-
-      /* check for end of block */
-      if (sym == 256)
-      {
-         *d->destLen += d->dest - start;
-         return TINF_OK;
-      }
-
-      if (sym < 256)
-      {
-         *d->dest++ = sym;
-
-      } else {
-
-         int length, dist, offs;
-         int i;
-
-         sym -= 257;
-
-         /* possibly get more bits from length code */
-         length = tinf_read_bits(d, length_bits[sym], length_base[sym]);
-
-         dist = tinf_decode_symbol(d, dt);
-
-         /* possibly get more bits from distance code */
-         offs = tinf_read_bits(d, dist_bits[dist], dist_base[dist]);
-
-         /* copy match */
-         for (i = 0; i < length; ++i)
-         {
-            d->dest[i] = d->dest[i - offs];
-         }
-
-         d->dest += length;
-      }
-   }
-}
-
-/* inflate an uncompressed block of data */
-static int tinf_inflate_uncompressed_block(TINF_DATA *d)
-{
-   unsigned int length, invlength;
-   unsigned int i;
-
-   /* get length */
-   length = d->source[1];
-   length = 256*length + d->source[0];
-
-   /* get one's complement of length */
-   invlength = d->source[3];
-   invlength = 256*invlength + d->source[2];
-
-   /* check length */
-   if (length != (~invlength & 0x0000ffff)) return TINF_DATA_ERROR;
-
-   d->source += 4;
-
-   /* copy block */
-   for (i = length; i; --i) *d->dest++ = *d->source++;
-
-   /* make sure we start next block on a byte boundary */
-   d->bitcount = 0;
-
-   *d->destLen += length;
-
-   return TINF_OK;
-}
-
-/* inflate a block of data compressed with fixed huffman trees */
-static int tinf_inflate_fixed_block(TINF_DATA *d)
-{
-   /* decode block using fixed trees */
-   return tinf_inflate_block_data(d, &sltree, &sdtree);
-}
-
-/* inflate a block of data compressed with dynamic huffman trees */
-static int tinf_inflate_dynamic_block(TINF_DATA *d)
-{
-   /* decode trees from stream */
-   tinf_decode_trees(d, &d->ltree, &d->dtree);
-
-   /* decode block using decoded trees */
-   return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
-}
-
-/* ---------------------- *
- * -- public functions -- *
- * ---------------------- */
-
-/* initialize global (static) data */
-void tinf_init()
-{
-   /* build fixed huffman trees */
-   tinf_build_fixed_trees(&sltree, &sdtree);
-
-   /* build extra bits and base tables */
-   tinf_build_bits_base(length_bits, length_base, 4, 3);
-   tinf_build_bits_base(dist_bits, dist_base, 2, 1);
-
-   /* fix a special case */
-   length_bits[28] = 0;
-   length_base[28] = 258;
-}
-
-size_t tinf_data_size() {
-	return sizeof(TINF_DATA);
-}
-
-/* inflate stream from source to dest */
-int tinf_uncompress(void *dest, unsigned int *destLen,
-                    const void *source, unsigned int sourceLen, void *v_tinf_data)
-{
-   int bfinal;
-
-   TINF_DATA *tinf_data = v_tinf_data;
-
-   /* initialise data */
-   tinf_data->source = (const unsigned char *)source;
-   tinf_data->bitcount = 0;
-
-   tinf_data->dest = (unsigned char *)dest;
-   tinf_data->destLen = destLen;
-
-   *destLen = 0;
-
-   do {
-
-      unsigned int btype;
-      int res;
-
-      /* read final block flag */
-      bfinal = tinf_getbit(tinf_data);
-
-      /* read block type (2 bits) */
-      btype = tinf_read_bits(tinf_data, 2, 0);
-
-      /* decompress block */
-      switch (btype)
-      {
-      case 0:
-         /* decompress uncompressed block */
-         res = tinf_inflate_uncompressed_block(tinf_data);
-         break;
-      case 1:
-         /* decompress block with fixed huffman trees */
-         res = tinf_inflate_fixed_block(tinf_data);
-         break;
-      case 2:
-         /* decompress block with dynamic huffman trees */
-         res = tinf_inflate_dynamic_block(tinf_data);
-         break;
-      default:
-         return TINF_DATA_ERROR;
-      }
-
-      if (res != TINF_OK) return TINF_DATA_ERROR;
-
-   } while (!bfinal);
-
-   return TINF_OK;
-}
+/*
+ * tinflate  -  tiny inflate
+ *
+ * Copyright (c) 2003 by Joergen Ibsen / Jibz
+ * All Rights Reserved
+ *
+ * http://www.ibsensoftware.com/
+ *
+ * This software is provided 'as-is', without any express
+ * or implied warranty.  In no event will the authors be
+ * held liable for any damages arising from the use of
+ * this software.
+ *
+ * Permission is granted to anyone to use this software
+ * for any purpose, including commercial applications,
+ * and to alter it and redistribute it freely, subject to
+ * the following restrictions:
+ *
+ * 1. The origin of this software must not be
+ *    misrepresented; you must not claim that you
+ *    wrote the original software. If you use this
+ *    software in a product, an acknowledgment in
+ *    the product documentation would be appreciated
+ *    but is not required.
+ *
+ * 2. Altered source versions must be plainly marked
+ *    as such, and must not be misrepresented as
+ *    being the original software.
+ *
+ * 3. This notice may not be removed or altered from
+ *    any source distribution.
+ */
+
+/*
+ * Two decoders: by default symbols are decoded with lookup tables from a
+ * 64-bit bit buffer. Define TINF_SMALL for the original bit-at-a-time
+ * decoder, whose state is much smaller.
+ */
+
+#include "tinf.h"
+
+#ifndef TINF_SMALL
+#include <stdint.h>
+#include <string.h>
+
+/* bits looked up at once for length/symbol and distance codes. Longer codes
+   continue in subtables; the sizes allow for the worst complete code. */
+#define TINF_LROOT 10
+#define TINF_DROOT 8
+#define TINF_LTABLE_SIZE ((1 << TINF_LROOT) + 1536)
+#define TINF_DTABLE_SIZE ((1 << TINF_DROOT) + 512)
+
+#define TINF_LINK 0x20 /* table entry points to a subtable */
+#endif
+
+/* ------------------------------ *
+ * -- internal data structures -- *
+ * ------------------------------ */
+
+#ifdef TINF_SMALL
+typedef struct {
+   unsigned short table[16];  /* table of code length counts */
+   unsigned short trans[288]; /* code -> symbol translation table */
+} TINF_TREE;
+
+typedef struct {
+   const unsigned char *source;
+   unsigned int tag;
+   unsigned int bitcount;
+
+   unsigned char *dest;
+   unsigned char *dest_end;
+   unsigned int *destLen;
+
+   TINF_TREE ltree; /* dynamic length/symbol tree */
+   TINF_TREE dtree; /* dynamic distance tree */
+} TINF_DATA;
+#else
+typedef struct {
+   const unsigned char *source;
+   const unsigned char *source_end;
+   uint64_t bitbuf;
+   unsigned int bitcount;
+   unsigned int padding; /* zero bytes buffered from past the end */
+
+   unsigned char *dest;
+   unsigned char *dest_start;
+   unsigned char *dest_end;
+   unsigned int *destLen;
+
+   unsigned int ltable[TINF_LTABLE_SIZE]; /* dynamic length/symbol table */
+   unsigned int dtable[TINF_DTABLE_SIZE]; /* dynamic distance table */
+} TINF_DATA;
+#endif
+
+/* --------------------------------------------------- *
+ * -- uninitialized global data (static structures) -- *
+ * --------------------------------------------------- */
+
+#ifdef TINF_SMALL
+TINF_TREE sltree; /* fixed length/symbol tree */
+TINF_TREE sdtree; /* fixed distance tree */
+#else
+unsigned int sltable[TINF_LTABLE_SIZE]; /* fixed length/symbol table */
+unsigned int sdtable[TINF_DTABLE_SIZE]; /* fixed distance table */
+#endif
+
+/* extra bits and base tables for length codes */
+unsigned char length_bits[30];
+unsigned short length_base[30];
+
+/* extra bits and base tables for distance codes */
+unsigned char dist_bits[30];
+unsigned short dist_base[30];
+
+/* special ordering of code length codes */
+const unsigned char clcidx[] = {
+   16, 17, 18, 0, 8, 7, 9, 6,
+   10, 5, 11, 4, 12, 3, 13, 2,
+   14, 1, 15
+};
+
+/* ----------------------- *
+ * -- utility functions -- *
+ * ----------------------- */
+
+/* build extra bits and base tables */
+static void tinf_build_bits_base(unsigned char *bits, unsigned short *base, int delta, int first)
+{
+   int i, sum;
+
+   /* build bits table */
+   for (i = 0; i < delta; ++i) bits[i] = 0;
+   for (i = 0; i < 30 - delta; ++i) bits[i + delta] = i / delta;
+
+   /* build base table */
+   for (sum = first, i = 0; i < 30; ++i)
+   {
+      base[i] = sum;
+      sum += 1 << bits[i];
+   }
+}
+
+#ifdef TINF_SMALL
+/* build the fixed huffman trees */
+static void tinf_build_fixed_trees(TINF_TREE *lt, TINF_TREE *dt)
+{
+   int i;
+
+   /* build fixed length tree */
+   for (i = 0; i < 7; ++i) lt->table[i] = 0;
+
+   lt->table[7] = 24;
+   lt->table[8] = 152;
+   lt->table[9] = 112;
+
+   for (i = 0; i < 24; ++i) lt->trans[i] = 256 + i;
+   for (i = 0; i < 144; ++i) lt->trans[24 + i] = i;
+   for (i = 0; i < 8; ++i) lt->trans[24 + 144 + i] = 280 + i;
+   for (i = 0; i < 112; ++i) lt->trans[24 + 144 + 8 + i] = 144 + i;
+
+   /* build fixed distance tree */
+   for (i = 0; i < 5; ++i) dt->table[i] = 0;
+
+   dt->table[5] = 32;
+
+   for (i = 0; i < 32; ++i) dt->trans[i] = i;
+}
+
+/* given an array of code lengths, build a tree */
+static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned int num)
+{
+   unsigned short offs[16];
+   unsigned int i, sum;
+
+   /* clear code length count table */
+   for (i = 0; i < 16; ++i) t->table[i] = 0;
+
+   /* scan symbol lengths, and sum code length counts */
+   for (i = 0; i < num; ++i) t->table[lengths[i]]++;
+
+   t->table[0] = 0;
+
+   /* compute offset table for distribution sort */
+   for (sum = 0, i = 0; i < 16; ++i)
+   {
+      offs[i] = sum;
+      sum += t->table[i];
+   }
+
+   /* create code->symbol translation table (symbols sorted by code) */
+   for (i = 0; i < num; ++i)
+   {
+      if (lengths[i]) t->trans[offs[lengths[i]]++] = i;
+   }
+}
+
+/* ---------------------- *
+ * -- decode functions -- *
+ * ---------------------- */
+
+/* get one bit from source stream */
+static int tinf_getbit(TINF_DATA *d)
+{
+   unsigned int bit;
+
+   /* check if tag is empty */
+   if (!d->bitcount--)
+   {
+      /* load next tag */
+      d->tag = *d->source++;
+      d->bitcount = 7;
+   }
+
+   /* shift bit out of tag */
+   bit = d->tag & 0x01;
+   d->tag >>= 1;
+
+   return bit;
+}
+
+/* read a num bit value from a stream and add base */
+static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
+{
+   unsigned int val = 0;
+
+   /* read num bits */
+   if (num)
+   {
+      unsigned int limit = 1 << (num);
+      unsigned int mask;
+
+      for (mask = 1; mask < limit; mask *= 2)
+         if (tinf_getbit(d)) val += mask;
+   }
+
+   return val + base;
+}
+
+/* given a data stream and a tree, decode a symbol */
+static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
+{
+   int sum = 0, cur = 0, len = 0;
+
+   /* get more bits while code value is above sum */
+   do {
+
+      cur = 2*cur + tinf_getbit(d);
+
+      ++len;
+
+      sum += t->table[len];
+      cur -= t->table[len];
+
+   } while (cur >= 0);
+
+   return t->trans[sum + cur];
+}
+
+/* given a data stream, decode dynamic trees from it */
+static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
+{
+   TINF_TREE code_tree;
+   unsigned char lengths[288+32];
+   unsigned int hlit, hdist, hclen;
+   unsigned int i, num, length;
+
+   /* get 5 bits HLIT (257-286) */
+   hlit = tinf_read_bits(d, 5, 257);
+
+   /* get 5 bits HDIST (1-32) */
+   hdist = tinf_read_bits(d, 5, 1);
+
+   /* get 4 bits HCLEN (4-19) */
+   hclen = tinf_read_bits(d, 4, 4);
+
+   for (i = 0; i < 19; ++i) lengths[i] = 0;
+
+   /* read code lengths for code length alphabet */
+   for (i = 0; i < hclen; ++i)
+   {
+      /* get 3 bits code length (0-7) */
+      unsigned int clen = tinf_read_bits(d, 3, 0);
+
+      lengths[clcidx[i]] = clen;
+   }
+
+   /* build code length tree */
+   tinf_build_tree(&code_tree, lengths, 19);
+
+   /* decode code lengths for the dynamic trees */
+   for (num = 0; num < hlit + hdist; )
+   {
+      int sym = tinf_decode_symbol(d, &code_tree);
+
+      switch (sym)
+      {
+      case 16:
+         /* copy previous code length 3-6 times (read 2 bits) */
+         {
+            unsigned char prev = lengths[num - 1];
+            for (length = tinf_read_bits(d, 2, 3); length; --length)
+            {
+               lengths[num++] = prev;
+            }
+         }
+         break;
+      case 17:
+         /* repeat code length 0 for 3-10 times (read 3 bits) */
+         for (length = tinf_read_bits(d, 3, 3); length; --length)
+         {
+            lengths[num++] = 0;
+         }
+         break;
+      case 18:
+         /* repeat code length 0 for 11-138 times (read 7 bits) */
+         for (length = tinf_read_bits(d, 7, 11); length; --length)
+         {
+            lengths[num++] = 0;
+         }
+         break;
+      default:
+         /* values 0-15 represent the actual code lengths */
+         lengths[num++] = sym;
+         break;
+      }
+   }
+
+   /* build dynamic trees */
+   tinf_build_tree(lt, lengths, hlit);
+   tinf_build_tree(dt, lengths + hlit, hdist);
+}
+
+/* ----------------------------- *
+ * -- block inflate functions -- *
+ * ----------------------------- */
+
+/* given a stream and two trees, inflate a block of data */
+static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
+{
+   /* remember current output position */
+   unsigned char *start = d->dest;
+
+   while (1)
+   {
+      int sym = tinf_decode_symbol(d, lt);
+
+      /* check for end of block */
+      if (sym == 256)
+      {
+         *d->destLen += d->dest - start;
+         return TINF_OK;
+      }
+
+      if (sym < 256)
+      {
+         if (d->dest == d->dest_end) return TINF_DATA_ERROR;
+
+         *d->dest++ = sym;
+
+      } else {
+
+         int length, dist, offs;
+         int i;
+
+         sym -= 257;
+
+         /* possibly get more bits from length code */
+         length = tinf_read_bits(d, length_bits[sym], length_base[sym]);
+
+         if (length > d->dest_end - d->dest) return TINF_DATA_ERROR;
+
+         dist = tinf_decode_symbol(d, dt);
+
+         /* possibly get more bits from distance code */
+         offs = tinf_read_bits(d, dist_bits[dist], dist_base[dist]);
+
+         /* copy match */
+         for (i = 0; i < length; ++i)
+         {
+            d->dest[i] = d->dest[i - offs];
+         }
+
+         d->dest += length;
+      }
+   }
+}
+
+/* inflate an uncompressed block of data */
+static int tinf_inflate_uncompressed_block(TINF_DATA *d)
+{
+   unsigned int length, invlength;
+   unsigned int i;
+
+   /* get length */
+   length = d->source[1];
+   length = 256*length + d->source[0];
+
+   /* get one's complement of length */
+   invlength = d->source[3];
+   invlength = 256*invlength + d->source[2];
+
+   /* check length */
+   if (length != (~invlength & 0x0000ffff)) return TINF_DATA_ERROR;
+
+   d->source += 4;
+
+   if (length > (unsigned int)(d->dest_end - d->dest)) return TINF_DATA_ERROR;
+
+   /* copy block */
+   for (i = length; i; --i) *d->dest++ = *d->source++;
+
+   /* make sure we start next block on a byte boundary */
+   d->bitcount = 0;
+
+   *d->destLen += length;
+
+   return TINF_OK;
+}
+
+/* inflate a block of data compressed with fixed huffman trees */
+static int tinf_inflate_fixed_block(TINF_DATA *d)
+{
+   /* decode block using fixed trees */
+   return tinf_inflate_block_data(d, &sltree, &sdtree);
+}
+
+/* inflate a block of data compressed with dynamic huffman trees */
+static int tinf_inflate_dynamic_block(TINF_DATA *d)
+{
+   /* decode trees from stream */
+   tinf_decode_trees(d, &d->ltree, &d->dtree);
+
+   /* decode block using decoded trees */
+   return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+}
+
+#else
+
+/* ------------------------------------------------- *
+ * -- table-driven decoding (unless TINF_SMALL)   -- *
+ * ------------------------------------------------- */
+
+/* reverse the low len bits of code */
+static unsigned int tinf_reverse(unsigned int code, int len)
+{
+   unsigned int rev = 0;
+
+   while (len--)
+   {
+      rev = (rev << 1) | (code & 1);
+      code >>= 1;
+   }
+
+   return rev;
+}
+
+/* given an array of code lengths, build a lookup table indexed by the next
+   root bits of input. Longer codes go through a subtable, sized for the
+   longest code sharing its root bits. Returns 0 if the lengths are
+   over-subscribed or need more room than size entries. */
+static int tinf_build_table(unsigned int *table, unsigned int size, int root, const unsigned char *lengths, unsigned int num)
+{
+   unsigned short count[16], offs[16], sorted[288];
+   unsigned char sub_bits[1 << TINF_LROOT];
+   unsigned int i, len, code, next, sym;
+   int left;
+
+   /* count code lengths and check they aren't over-subscribed */
+   for (i = 0; i < 16; ++i) count[i] = 0;
+   for (i = 0; i < num; ++i) count[lengths[i]]++;
+   count[0] = 0;
+
+   for (left = 1, len = 1; len < 16; ++len)
+   {
+      left = 2*left - count[len];
+      if (left < 0) return 0;
+   }
+
+   /* sort symbols by code, as tinf_build_tree does */
+   for (code = 0, len = 0; len < 16; ++len)
+   {
+      offs[len] = code;
+      code += count[len];
+   }
+
+   for (i = 0; i < num; ++i)
+   {
+      if (lengths[i]) sorted[offs[lengths[i]]++] = i;
+   }
+
+   /* codes sharing their first root bits are adjacent, with the longest
+      last, so the last one seen sizes the subtable */
+   for (i = 0; i < (1u << root); ++i)
+   {
+      table[i] = 0;
+      sub_bits[i] = 0;
+   }
+
+   for (code = 0, len = root + 1; len < 16; ++len)
+   {
+      /* canonical codes of this length start here */
+      for (code = 0, i = 1; i < len; ++i) code = (code + count[i]) << 1;
+
+      for (i = 0; i < count[len]; ++i, ++code)
+         sub_bits[tinf_reverse(code >> (len - root), root)] = len - root;
+   }
+
+   for (next = 1u << root, i = 0; i < (1u << root); ++i)
+   {
+      if (sub_bits[i])
+      {
+         unsigned int j;
+
+         if (next + (1u << sub_bits[i]) > size) return 0;
+
+         table[i] = (next << 16) | TINF_LINK | sub_bits[i];
+         for (j = 0; j < (1u << sub_bits[i]); ++j) table[next + j] = 0;
+         next += 1u << sub_bits[i];
+      }
+   }
+
+   /* fill in every entry each code covers */
+   for (code = 0, sym = 0, len = 1; len < 16; ++len)
+   {
+      for (i = 0; i < count[len]; ++i, ++code, ++sym)
+      {
+         unsigned int rev = tinf_reverse(code, len);
+         unsigned int entry = (sorted[sym] << 16) | len;
+
+         if (len <= (unsigned int)root)
+         {
+            for (; rev < (1u << root); rev += 1u << len) table[rev] = entry;
+         } else {
+            unsigned int link = table[rev & ((1u << root) - 1)];
+            unsigned int *sub = table + (link >> 16);
+
+            for (rev >>= root; rev < (1u << (link & 31)); rev += 1u << (len - root)) sub[rev] = entry;
+         }
+      }
+
+      code <<= 1;
+   }
+
+   return 1;
+}
+
+/* build the fixed huffman tables */
+static void tinf_build_fixed_tables(unsigned int *lt, unsigned int *dt)
+{
+   unsigned char lengths[288];
+   int i;
+
+   for (i = 0; i < 144; ++i) lengths[i] = 8;
+   for (; i < 256; ++i) lengths[i] = 9;
+   for (; i < 280; ++i) lengths[i] = 7;
+   for (; i < 288; ++i) lengths[i] = 8;
+
+   tinf_build_table(lt, TINF_LTABLE_SIZE, TINF_LROOT, lengths, 288);
+
+   for (i = 0; i < 30; ++i) lengths[i] = 5;
+
+   tinf_build_table(dt, TINF_DTABLE_SIZE, TINF_DROOT, lengths, 30);
+}
+
+/* top up the bit buffer to at least 57 bits. Past the end of the source it
+   fills with zeroes, counting them so they aren't mistaken for data. */
+static void tinf_refill(TINF_DATA *d)
+{
+   if (d->source_end - d->source >= 8)
+   {
+      const unsigned char *s = d->source;
+      uint64_t word = (uint64_t)s[0] | ((uint64_t)s[1] << 8) | ((uint64_t)s[2] << 16) | ((uint64_t)s[3] << 24)
+                    | ((uint64_t)s[4] << 32) | ((uint64_t)s[5] << 40) | ((uint64_t)s[6] << 48) | ((uint64_t)s[7] << 56);
+
+      d->bitbuf |= word << d->bitcount;
+      d->source += (63 - d->bitcount) >> 3;
+      d->bitcount |= 56;
+      return;
+   }
+
+   while (d->bitcount <= 56)
+   {
+      if (d->source < d->source_end)
+         d->bitbuf |= (uint64_t)*d->source++ << d->bitcount;
+      else
+         d->padding++;
+
+      d->bitcount += 8;
+   }
+}
+
+/* take num bits from the buffer */
+static unsigned int tinf_take_bits(TINF_DATA *d, int num)
+{
+   unsigned int val = (unsigned int)(d->bitbuf & ((1u << num) - 1));
+
+   d->bitbuf >>= num;
+   d->bitcount -= num;
+
+   return val;
+}
+
+/* read a num bit value from a stream and add base */
+static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
+{
+   if (d->bitcount < (unsigned int)num) tinf_refill(d);
+
+   return tinf_take_bits(d, num) + base;
+}
+
+/* get one bit from source stream */
+static int tinf_getbit(TINF_DATA *d)
+{
+   return tinf_read_bits(d, 1, 0);
+}
+
+/* look up the next symbol. Entries are (symbol << 16) | length; length is 0
+   for codes which aren't in use. The buffer must hold at least 15 bits. */
+static unsigned int tinf_lookup(const unsigned int *table, int root, uint64_t bits)
+{
+   unsigned int entry = table[bits & ((1u << root) - 1)];
+
+   if (entry & TINF_LINK)
+      entry = table[(entry >> 16) + ((bits >> root) & ((1u << (entry & 31)) - 1))];
+
+   return entry;
+}
+
+/* given a data stream, decode dynamic tables from it */
+static int tinf_decode_trees(TINF_DATA *d)
+{
+   unsigned int code_table[1 << 7];
+   unsigned char lengths[288+32];
+   unsigned int hlit, hdist, hclen;
+   unsigned int i, num, length;
+
+   /* get 5 bits HLIT (257-286) */
+   hlit = tinf_read_bits(d, 5, 257);
+
+   /* get 5 bits HDIST (1-32) */
+   hdist = tinf_read_bits(d, 5, 1);
+
+   /* get 4 bits HCLEN (4-19) */
+   hclen = tinf_read_bits(d, 4, 4);
+
+   for (i = 0; i < 19; ++i) lengths[i] = 0;
+
+   /* read code lengths for code length alphabet */
+   for (i = 0; i < hclen; ++i)
+   {
+      /* get 3 bits code length (0-7) */
+      lengths[clcidx[i]] = tinf_read_bits(d, 3, 0);
+   }
+
+   /* build code length table: codes are at most 7 bits, so no subtables */
+   if (!tinf_build_table(code_table, 1 << 7, 7, lengths, 19)) return TINF_DATA_ERROR;
+
+   /* decode code lengths for the dynamic tables */
+   for (num = 0; num < hlit + hdist; )
+   {
+      unsigned int entry, sym;
+
+      tinf_refill(d);
+
+      entry = tinf_lookup(code_table, 7, d->bitbuf);
+      if (!(entry & 31)) return TINF_DATA_ERROR;
+
+      tinf_take_bits(d, entry & 31);
+      sym = entry >> 16;
+
+      switch (sym)
+      {
+      case 16:
+         /* copy previous code length 3-6 times (read 2 bits) */
+         if (num == 0) return TINF_DATA_ERROR;
+         length = tinf_take_bits(d, 2) + 3;
+         if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+         for (; length; --length, ++num) lengths[num] = lengths[num - 1];
+         break;
+      case 17:
+         /* repeat code length 0 for 3-10 times (read 3 bits) */
+         length = tinf_take_bits(d, 3) + 3;
+         if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+         for (; length; --length) lengths[num++] = 0;
+         break;
+      case 18:
+         /* repeat code length 0 for 11-138 times (read 7 bits) */
+         length = tinf_take_bits(d, 7) + 11;
+         if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+         for (; length; --length) lengths[num++] = 0;
+         break;
+      default:
+         /* values 0-15 represent the actual code lengths */
+         lengths[num++] = sym;
+         break;
+      }
+   }
+
+   /* build dynamic tables */
+   if (!tinf_build_table(d->ltable, TINF_LTABLE_SIZE, TINF_LROOT, lengths, hlit)) return TINF_DATA_ERROR;
+   if (!tinf_build_table(d->dtable, TINF_DTABLE_SIZE, TINF_DROOT, lengths + hlit, hdist)) return TINF_DATA_ERROR;
+
+   return TINF_OK;
+}
+
+/* copy a match of length bytes from offs bytes back. Overlapping matches
+   repeat a pattern, so copy a word at a time only once offs is a whole
+   word, and never write past the end of the match. */
+static unsigned char *tinf_copy_match(unsigned char *dest, unsigned int length, unsigned int offs)
+{
+   const unsigned char *src = dest - offs;
+
+   if (offs == 1)
+   {
+      memset(dest, *src, length);
+      return dest + length;
+   }
+
+   if (offs >= sizeof(uint64_t))
+   {
+      for (; length >= sizeof(uint64_t); length -= sizeof(uint64_t))
+      {
+         memcpy(dest, src, sizeof(uint64_t));
+         dest += sizeof(uint64_t);
+         src += sizeof(uint64_t);
+      }
+   }
+
+   while (length--) *dest++ = *src++;
+
+   return dest;
+}
+
+/* given a stream and two tables, inflate a block of data */
+static int tinf_inflate_block_data(TINF_DATA *d, const unsigned int *lt, const unsigned int *dt)
+{
+   /* remember current output position */
+   unsigned char *start = d->dest;
+   unsigned char *dest = d->dest;
+   int res = TINF_OK;
+
+   while (1)
+   {
+      unsigned int entry, sym;
+
+      /* enough bits for a length, a distance and their extra bits */
+      tinf_refill(d);
+
+      entry = tinf_lookup(lt, TINF_LROOT, d->bitbuf);
+      if (!(entry & 31))
+      {
+         res = TINF_DATA_ERROR;
+         break;
+      }
+
+      tinf_take_bits(d, entry & 31);
+      sym = entry >> 16;
+
+      if (sym < 256)
+      {
+         if (dest == d->dest_end)
+         {
+            res = TINF_DATA_ERROR;
+            break;
+         }
+
+         *dest++ = sym;
+
+      } else if (sym == 256) {
+
+         /* end of block */
+         break;
+
+      } else {
+
+         unsigned int length, dist, offs;
+
+         sym -= 257;
+         if (sym >= 29)
+         {
+            res = TINF_DATA_ERROR;
+            break;
+         }
+
+         /* possibly get more bits from length code */
+         length = tinf_take_bits(d, length_bits[sym]) + length_base[sym];
+
+         entry = tinf_lookup(dt, TINF_DROOT, d->bitbuf);
+         dist = entry >> 16;
+         if (!(entry & 31) || dist >= 30)
+         {
+            res = TINF_DATA_ERROR;
+            break;
+         }
+
+         tinf_take_bits(d, entry & 31);
+
+         /* possibly get more bits from distance code */
+         offs = tinf_take_bits(d, dist_bits[dist]) + dist_base[dist];
+         if (offs > (unsigned int)(dest - d->dest_start)
+               || length > (unsigned int)(d->dest_end - dest))
+         {
+            res = TINF_DATA_ERROR;
+            break;
+         }
+
+         dest = tinf_copy_match(dest, length, offs);
+      }
+   }
+
+   d->dest = dest;
+   *d->destLen += dest - start;
+
+   return res;
+}
+
+/* inflate an uncompressed block of data */
+static int tinf_inflate_uncompressed_block(TINF_DATA *d)
+{
+   unsigned int length, invlength;
+   unsigned int buffered;
+
+   /* start on a byte boundary, and give back whole bytes still buffered */
+   tinf_take_bits(d, d->bitcount & 7);
+
+   buffered = d->bitcount / 8;
+   if (buffered < d->padding) return TINF_DATA_ERROR;
+
+   d->source -= buffered - d->padding;
+   d->bitbuf = 0;
+   d->bitcount = 0;
+   d->padding = 0;
+
+   if (d->source_end - d->source < 4) return TINF_DATA_ERROR;
+
+   /* get length */
+   length = d->source[1];
+   length = 256*length + d->source[0];
+
+   /* get one's complement of length */
+   invlength = d->source[3];
+   invlength = 256*invlength + d->source[2];
+
+   /* check length */
+   if (length != (~invlength & 0x0000ffff)) return TINF_DATA_ERROR;
+
+   d->source += 4;
+
+   if ((unsigned int)(d->source_end - d->source) < length) return TINF_DATA_ERROR;
+   if ((unsigned int)(d->dest_end - d->dest) < length) return TINF_DATA_ERROR;
+
+   /* copy block */
+   memcpy(d->dest, d->source, length);
+   d->dest += length;
+   d->source += length;
+
+   *d->destLen += length;
+
+   return TINF_OK;
+}
+
+/* inflate a block of data compressed with fixed huffman trees */
+static int tinf_inflate_fixed_block(TINF_DATA *d)
+{
+   /* decode block using fixed tables */
+   return tinf_inflate_block_data(d, sltable, sdtable);
+}
+
+/* inflate a block of data compressed with dynamic huffman trees */
+static int tinf_inflate_dynamic_block(TINF_DATA *d)
+{
+   /* decode tables from stream */
+   if (tinf_decode_trees(d) != TINF_OK) return TINF_DATA_ERROR;
+
+   /* decode block using decoded tables */
+   return tinf_inflate_block_data(d, d->ltable, d->dtable);
+}
+
+#endif
+
+/* ---------------------- *
+ * -- public functions -- *
+ * ---------------------- */
+
+/* initialize global (static) data */
+void tinf_init()
+{
+#ifdef TINF_SMALL
+   /* build fixed huffman trees */
+   tinf_build_fixed_trees(&sltree, &sdtree);
+#endif
+
+   /* build extra bits and base tables */
+   tinf_build_bits_base(length_bits, length_base, 4, 3);
+   tinf_build_bits_base(dist_bits, dist_base, 2, 1);
+
+   /* fix a special case */
+   length_bits[28] = 0;
+   length_base[28] = 258;
+
+#ifndef TINF_SMALL
+   /* build fixed huffman tables */
+   tinf_build_fixed_tables(sltable, sdtable);
+#endif
+}
+
+size_t tinf_data_size() {
+	return sizeof(TINF_DATA);
+}
+
+/* inflate stream from source to dest */
+int tinf_uncompress(void *dest, unsigned int *destLen,
+                    const void *source, unsigned int sourceLen, void *v_tinf_data)
+{
+   int bfinal;
+
+   TINF_DATA *tinf_data = v_tinf_data;
+
+   /* initialise data */
+   tinf_data->source = (const unsigned char *)source;
+   tinf_data->bitcount = 0;
+#ifndef TINF_SMALL
+   tinf_data->source_end = tinf_data->source + sourceLen;
+   tinf_data->bitbuf = 0;
+   tinf_data->padding = 0;
+   tinf_data->dest_start = (unsigned char *)dest;
+#endif
+
+   tinf_data->dest = (unsigned char *)dest;
+   tinf_data->dest_end = tinf_data->dest + *destLen;
+   tinf_data->destLen = destLen;
+
+   *destLen = 0;
+
+   do {
+
+      unsigned int btype;
+      int res;
+
+      /* read final block flag */
+      bfinal = tinf_getbit(tinf_data);
+
+      /* read block type (2 bits) */
+      btype = tinf_read_bits(tinf_data, 2, 0);
+
+      /* decompress block */
+      switch (btype)
+      {
+      case 0:
+         /* decompress uncompressed block */
+         res = tinf_inflate_uncompressed_block(tinf_data);
+         break;
+      case 1:
+         /* decompress block with fixed huffman trees */
+         res = tinf_inflate_fixed_block(tinf_data);
+         break;
+      case 2:
+         /* decompress block with dynamic huffman trees */
+         res = tinf_inflate_dynamic_block(tinf_data);
+         break;
+      default:
+         return TINF_DATA_ERROR;
+      }
+
+      if (res != TINF_OK) return TINF_DATA_ERROR;
+
+   } while (!bfinal);
+
+   return TINF_OK;
+}
@@ -42,6 +42,10 @@ int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
    int res;
    unsigned char cmf, flg;
 
+   /* -- check there is room for the header and checksum -- */
+
+   if (sourceLen < 6) return TINF_DATA_ERROR;
+
    /* -- get header bytes -- */
 
    cmf = src[0];
@@ -5,20 +5,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "wad.h"
 
+/* Bump the last character of the magic when the header layout changes, so
+ * that old wads are rejected rather than misread. */
+#define WAD_MAGIC "mes2"
+
 struct wad_header {
-	uint32_t magic;
+	char magic[4]; // WAD_MAGIC
 	uint32_t file_count;
 	uint32_t choreography_file_idx;
+	uint32_t manifest_file_idx; // 0xffffffff if none
 };
 
 struct wad_idx {
 	uint32_t offset;
-	uint32_t size;
+	uint32_t size; // top bit set if compressed
 };
 
+#define WAD_COMPRESSED 0x80000000
+
 static inline struct wad_idx *wad_get_file_idx(uint8_t *wad, unsigned file_idx)
 {
 	struct wad_header *header = (struct wad_header*)wad;
@@ -40,7 +48,19 @@ uint32_t wad_get_file_offset(uint8_t *wad, int file_idx)
 size_t wad_get_file_size(uint8_t *wad, int file_idx)
 {
 	struct wad_idx *idx = wad_get_file_idx(wad, file_idx);
-	return idx ? idx->size: 0;
+	return idx ? (idx->size & ~WAD_COMPRESSED): 0;
+}
+
+bool wad_file_is_compressed(uint8_t *wad, int file_idx)
+{
+	struct wad_idx *idx = wad_get_file_idx(wad, file_idx);
+	return idx ? (idx->size & WAD_COMPRESSED) != 0: false;
+}
+
+int wad_get_choreography_file_idx(uint8_t *wad)
+{
+	struct wad_header *header = (struct wad_header*)wad;
+	return header->choreography_file_idx;
 }
 
 uint32_t wad_get_choreography_offset(uint8_t *wad)
@@ -49,3 +69,27 @@ uint32_t wad_get_choreography_offset(uint8_t *wad)
 	return wad_get_file_offset(wad, header->choreography_file_idx);
 }
 
+size_t wad_get_choreography_size(uint8_t *wad)
+{
+	struct wad_header *header = (struct wad_header*)wad;
+	return wad_get_file_size(wad, header->choreography_file_idx);
+}
+
+int wad_get_manifest_file_idx(uint8_t *wad)
+{
+	struct wad_header *header = (struct wad_header*)wad;
+	return header->manifest_file_idx < header->file_count ? (int)header->manifest_file_idx : -1;
+}
+
+bool wad_check_header(uint8_t *wad)
+{
+	struct wad_header *header = (struct wad_header*)wad;
+	return memcmp(header->magic, WAD_MAGIC, 4) == 0;
+}
+
+int wad_get_file_count(uint8_t *wad)
+{
+	struct wad_header *header = (struct wad_header*)wad;
+	return header->file_count;
+}
+
@@ -1,8 +1,15 @@
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <sys/types.h>
 
+bool wad_check_header(uint8_t *wad); // false if it isn't a wad, or is in an older format
 uint32_t wad_get_file_offset(uint8_t *wad, int file_idx);
-size_t wad_get_file_size(uint8_t *wad, int file_idx);
+size_t wad_get_file_size(uint8_t *wad, int file_idx); // as stored, so compressed if the file is
+bool wad_file_is_compressed(uint8_t *wad, int file_idx);
+int wad_get_choreography_file_idx(uint8_t *wad);
 uint32_t wad_get_choreography_offset(uint8_t *wad);
+size_t wad_get_choreography_size(uint8_t *wad);
+int wad_get_file_count(uint8_t *wad);
+int wad_get_manifest_file_idx(uint8_t *wad); // -1 if the wad has no manifest
 
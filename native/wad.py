@@ -3,21 +3,32 @@ Make a big file what has smaller files inside it.
 
 Format:
 
-4 bytes: 'mess'
+4 bytes: 'mes2' (was 'mess' before the manifest index was added)
 4 bytes: number of files
 4 bytes: index of the choreography file
+4 bytes: index of the manifest file, or 0xffffffff if there isn't one
 4 bytes: index (from start of file) to beginning of first file
 4 bytes: length of first file
 ...
+
+If the top bit of a file's length is set, the file is compressed and the
+length is of the compressed form: 4 bytes of uncompressed length, then a
+zlib stream. Files are only compressed if asked for and it makes them
+smaller. The Pebble watchface can't read compressed files.
 """
 import struct
+import zlib
+
+COMPRESSED = 0x80000000
 
 class Wad:
-	def __init__(self, endian):
+	def __init__(self, endian, compress=False):
 		# endian in struct format, i.e. > or <
 		self.files = [] # list of (size, data) tuples
+		self.compress = compress
 		self.filename_to_idx = {}
 		self.choreography_idx = -1
+		self.manifest_idx = 0xffffffff
 		self.endian = endian
 
 	def add(self, filename, is_choreography=False):
@@ -32,7 +43,7 @@ class Wad:
 
 		return idx
 
-	def add_bin(self, filedata, is_choreography=False, filename=None):
+	def add_bin(self, filedata, is_choreography=False, filename=None, is_manifest=False):
 		if filename is not None and filename in self.filename_to_idx:
 			idx = self.filename_to_idx[filename]
 		else:
@@ -47,6 +58,9 @@ class Wad:
 			if is_choreography:
 				self.choreography_idx = idx
 
+			if is_manifest:
+				self.manifest_idx = idx
+
 			if filename is not None:
 				self.filename_to_idx[filename] = idx
 
@@ -55,24 +69,47 @@ class Wad:
 	def __contains__(self, filename):
 		return filename in self.filename_to_idx
 
+	def data(self, idx):
+		return self.files[idx][1]
+
+	def stored(self, filelength, filedata):
+		""" The (index length, data) to write for a file """
+		if self.compress:
+			compressed = struct.pack(self.endian + 'I', filelength) + zlib.compress(filedata[:filelength], 9)
+			if len(compressed) < filelength:
+				storedlength = len(compressed)
+				if len(compressed) % 4 != 0:
+					compressed += b'\0' * (4 - (len(compressed) % 4))
+				return storedlength | COMPRESSED, compressed
+
+		return filelength, filedata
+
 	def write(self, filename):
 		# calculate sizes
-		first_file_position = 4 + 4 + 4 + (len(self.files) * 4 * 2)
+		first_file_position = 4 + 4 + 4 + 4 + (len(self.files) * 4 * 2)
 		next_file_position = first_file_position
 
+		stored_files = [self.stored(filelength, filedata) for filelength, filedata in self.files]
+
 		with open(filename, 'wb') as h:
-			h.write(b'mess')
-			h.write(struct.pack(self.endian + 'II', len(self.files), self.choreography_idx))
+			h.write(b'mes2')
+			h.write(struct.pack(self.endian + 'III', len(self.files), self.choreography_idx, self.manifest_idx))
 
 			# write index
-			for filelength, filedata in self.files:
+			for filelength, filedata in stored_files:
 				h.write(struct.pack(self.endian + 'II', next_file_position, filelength))
 				next_file_position += len(filedata)
 
 			# write data
-			for filelength, filedata in self.files:
+			for filelength, filedata in stored_files:
 				h.write(filedata)
 
+		if self.compress:
+			raw = sum(len(filedata) for filelength, filedata in self.files)
+			stored = sum(len(filedata) for filelength, filedata in stored_files)
+			print("compressed %d of %d files, %d bytes to %d" % (sum(1 for filelength, filedata in stored_files if filelength & COMPRESSED),
+				len(self.files), raw, stored))
+
 		return first_file_position
 
 
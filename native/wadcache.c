@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef BACKEND_SUPPORTS_PREFETCH
+#include <pthread.h>
+#endif
+
+#include "tinf/src/tinf.h"
+
+#include "backend.h"
+#include "wad.h"
+#include "wadcache.h"
+
+// Most decompressed data to hold, loaded or not.
+#ifndef WAD_CACHE_KB
+#define WAD_CACHE_KB 16384
+#endif
+
+// Most files to hold at once.
+#ifndef WAD_CACHE_ENTRIES
+#define WAD_CACHE_ENTRIES 64
+#endif
+
+struct entry {
+	int file_idx; // -1 if unused
+	uint8_t *data; // NULL while loading
+	size_t size;
+	int refs; // loads not yet unloaded
+	unsigned last_used;
+};
+
+static uint8_t *wad;
+static struct entry entries[WAD_CACHE_ENTRIES];
+static size_t cached_bytes;
+static unsigned cache_clock;
+
+/* Files are decompressed outside the lock, so one thread inflating a big
+ * file doesn't hold up the other loading a small one. */
+#ifdef BACKEND_SUPPORTS_PREFETCH
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loaded = PTHREAD_COND_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#define WAIT_FOR_LOAD() pthread_cond_wait(&loaded, &lock)
+#define LOAD_DONE() pthread_cond_broadcast(&loaded)
+#else
+#define LOCK()
+#define UNLOCK()
+#define WAIT_FOR_LOAD()
+#define LOAD_DONE()
+#endif
+
+bool wadcache_init(uint8_t *wad_in)
+{
+	wad = wad_in;
+
+	for(int i = 0; i < WAD_CACHE_ENTRIES; i++)
+		entries[i].file_idx = -1;
+
+	cached_bytes = 0;
+
+	return true;
+}
+
+static void evict(struct entry *entry)
+{
+	free(entry->data);
+	cached_bytes -= entry->size;
+
+	entry->file_idx = -1;
+	entry->data = NULL;
+	entry->size = 0;
+}
+
+void wadcache_shutdown(void)
+{
+	for(int i = 0; i < WAD_CACHE_ENTRIES; i++) {
+		if(entries[i].file_idx != -1)
+			evict(&entries[i]);
+	}
+}
+
+static struct entry *find(int file_idx)
+{
+	for(int i = 0; i < WAD_CACHE_ENTRIES; i++) {
+		if(entries[i].file_idx == file_idx)
+			return &entries[i];
+	}
+
+	return NULL;
+}
+
+/* Return an unused entry with room for 'size' more bytes, evicting as
+ * needed. Goes over budget rather than fail if everything is loaded. */
+static struct entry *make_room(size_t size)
+{
+	for(;;) {
+		struct entry *unused = NULL, *victim = NULL;
+
+		for(int i = 0; i < WAD_CACHE_ENTRIES; i++) {
+			struct entry *entry = &entries[i];
+
+			if(entry->file_idx == -1) {
+				if(unused == NULL)
+					unused = entry;
+			} else if(entry->refs == 0 && (victim == NULL || entry->last_used < victim->last_used)) {
+				victim = entry;
+			}
+		}
+
+		if(unused && cached_bytes + size <= WAD_CACHE_KB * 1024)
+			return unused;
+
+		if(victim == NULL) {
+			if(unused)
+				backend_debug("wadcache: over budget with %zu bytes loaded", cached_bytes);
+			return unused;
+		}
+
+		evict(victim);
+	}
+}
+
+/* Compressed files are the uncompressed size followed by a zlib stream. */
+static bool uncompressed_size(int file_idx, uint32_t *size)
+{
+	if(wad_get_file_size(wad, file_idx) < sizeof(*size))
+		return false;
+
+	memcpy(size, wad + wad_get_file_offset(wad, file_idx), sizeof(*size));
+	return true;
+}
+
+/* Smallest zlib stream: two header bytes and the adler32 trailer. */
+#define ZLIB_MIN_BYTES 6
+
+/* The decompressor is told the size too, so a corrupt file can't overrun
+ * the output; streams too short to hold a zlib header and trailer are
+ * refused before tinf reads either. */
+static uint8_t *inflate_file(int file_idx, uint32_t size)
+{
+	uint8_t *stored = wad + wad_get_file_offset(wad, file_idx);
+	size_t stored_size = wad_get_file_size(wad, file_idx);
+
+	if(stored_size < sizeof(size) + ZLIB_MIN_BYTES) {
+		backend_debug("wadcache: file %d is truncated", file_idx);
+		return NULL;
+	}
+
+	uint8_t *data = malloc(size ? size : 1);
+	void *tinf_data = malloc(tinf_data_size());
+	unsigned int out_size = size;
+
+	if(data == NULL || tinf_data == NULL
+			|| tinf_zlib_uncompress(data, &out_size, stored + sizeof(size), stored_size - sizeof(size), tinf_data) != TINF_OK
+			|| out_size != size) {
+		backend_debug("wadcache: file %d is corrupt", file_idx);
+		free(tinf_data);
+		free(data);
+		return NULL;
+	}
+
+	free(tinf_data);
+	return data;
+}
+
+/* An entry for the file, loaded or being loaded by another thread, or NULL. */
+static struct entry *find_loaded(int file_idx)
+{
+	struct entry *entry;
+
+	while((entry = find(file_idx)) != NULL && entry->data == NULL)
+		WAIT_FOR_LOAD();
+
+	return entry;
+}
+
+void *wadcache_load(int file_idx, size_t *size_out)
+{
+	LOCK();
+
+	struct entry *entry = find_loaded(file_idx);
+	if(entry == NULL) {
+		uint32_t size;
+		if(!uncompressed_size(file_idx, &size)) {
+			backend_debug("wadcache: file %d is corrupt", file_idx);
+			UNLOCK();
+			return NULL;
+		}
+
+		/* Claim an entry so that nobody else loads the same file, and hold a
+		 * reference so it isn't evicted while we work. */
+		entry = make_room(size);
+		if(entry == NULL) {
+			backend_debug("wadcache: too many files loaded");
+			UNLOCK();
+			return NULL;
+		}
+
+		entry->file_idx = file_idx;
+		entry->data = NULL;
+		entry->size = size;
+		entry->refs = 1;
+		cached_bytes += size;
+
+		UNLOCK();
+		uint8_t *data = inflate_file(file_idx, size);
+		LOCK();
+
+		if(data == NULL) {
+			evict(entry);
+			entry = NULL;
+		} else {
+			entry->data = data;
+			entry->refs--; // taken again below
+		}
+
+		LOAD_DONE();
+	}
+
+	if(entry) {
+		entry->refs++;
+		entry->last_used = ++cache_clock;
+
+		if(size_out != NULL)
+			*size_out = entry->size;
+	}
+
+	UNLOCK();
+
+	return entry ? entry->data : NULL;
+}
+
+bool wadcache_unload(void *data)
+{
+	bool found = false;
+
+	LOCK();
+
+	for(int i = 0; i < WAD_CACHE_ENTRIES; i++) {
+		if(entries[i].file_idx != -1 && entries[i].data != NULL && entries[i].data == data) {
+			if(entries[i].refs > 0)
+				entries[i].refs--;
+			found = true;
+			break;
+		}
+	}
+
+	UNLOCK();
+
+	return found;
+}
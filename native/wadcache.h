@@ -0,0 +1,17 @@
+#ifndef WADCACHE_H
+#define WADCACHE_H
+
+/* Compressed WAD files are decompressed when loaded, into a cache of bounded
+ * size. Files still loaded are never evicted; the others go least recently
+ * used first. Safe to use from the prefetch worker. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+bool wadcache_init(uint8_t *wad);
+void wadcache_shutdown(void);
+void *wadcache_load(int file_idx, size_t *size_out);
+bool wadcache_unload(void *data); // false if the data didn't come from the cache
+
+#endif // WADCACHE_H